@@ -0,0 +1,42 @@
+# A Simple liburing Finder.
+# Usage:
+# find_package(uring)
+#
+# Declares:
+#  * URING_FOUND
+#  * URING_INCLUDE_DIRS
+#  * URING_LIBRARIES
+#
+
+set(URING_SEARCH_PATHS
+    /usr/local/
+    /usr/
+    /opt
+)
+
+find_path(URING_INCLUDE_DIR liburing.h
+    HINTS
+    PATH_SUFFIXES include
+    PATHS ${URING_SEARCH_PATHS}
+)
+
+find_library(URING_LIBRARY
+    NAMES uring
+    HINTS
+    PATH_SUFFIXES lib
+    PATHS ${URING_SEARCH_PATHS}
+)
+
+if(URING_INCLUDE_DIR AND URING_LIBRARY)
+   set(URING_FOUND TRUE)
+endif()
+
+if(URING_FOUND)
+    set(URING_LIBRARIES ${URING_LIBRARY})
+    set(URING_INCLUDE_DIRS ${URING_INCLUDE_DIR})
+    message(STATUS "Found liburing: ${URING_LIBRARIES}")
+else()
+    message(STATUS "Could not find liburing, queued file sources will use pread")
+endif()
+
+mark_as_advanced(URING_LIBRARY URING_INCLUDE_DIR URING_SEARCH_PATHS)
@@ -0,0 +1,87 @@
+#include <kitchensink/kitchensink.h>
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+/*
+* Measures how decoding a whole file with Kit_DecodeFileParallel scales with the number of
+* worker threads, from one thread up to the given maximum.
+*
+* Note! This example does not do proper error handling etc.
+* It is for example use only!
+*/
+
+typedef struct {
+    int frames;
+    double last_pts;
+    bool in_order;
+} DecodeStats;
+
+static int count_frame(SDL_Surface *frame, double pts, void *userdata) {
+    DecodeStats *stats = (DecodeStats*)userdata;
+    (void)frame;
+    if(stats->frames > 0 && pts < stats->last_pts) {
+        stats->in_order = false;
+    }
+    stats->last_pts = pts;
+    stats->frames++;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if(argc < 2) {
+        fprintf(stderr, "Usage: exampledecodebench <filename> [max threads] [width]\n");
+        return 0;
+    }
+    const char *filename = argv[1];
+    int max_threads = (argc > 2) ? atoi(argv[2]) : SDL_GetCPUCount();
+    int width = (argc > 3) ? atoi(argv[3]) : 0;
+    if(max_threads < 1) {
+        fprintf(stderr, "Thread count must be at least 1\n");
+        return 1;
+    }
+
+    if(SDL_Init(0) != 0) {
+        fprintf(stderr, "Unable to initialize SDL!\n");
+        return 1;
+    }
+    if(Kit_Init(KIT_INIT_FORMATS) != 0) {
+        fprintf(stderr, "Unable to initialize Kitchensink: %s", Kit_GetError());
+        return 1;
+    }
+
+    // Build the keyframe index once, so that the runs below only measure decoding
+    Kit_KeyframeIndex *index = Kit_BuildKeyframeIndex(filename, -1);
+    if(index == NULL) {
+        fprintf(stderr, "Unable to index %s: %s\n", filename, Kit_GetError());
+        return 1;
+    }
+
+    double base_ms = 0;
+    int base_frames = 0;
+    for(int threads = 1; threads <= max_threads; threads++) {
+        DecodeStats stats = {0, 0, true};
+        Uint64 start = SDL_GetPerformanceCounter();
+        if(Kit_DecodeFileParallel(filename, index, width, 0, threads, count_frame, &stats) != 0) {
+            fprintf(stderr, "Unable to decode %s: %s\n", filename, Kit_GetError());
+            return 1;
+        }
+        double ms = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+        if(threads == 1) {
+            base_ms = ms;
+            base_frames = stats.frames;
+        }
+        if(!stats.in_order || stats.frames != base_frames) {
+            fprintf(stderr, "Output with %d threads differs from the single threaded run!\n", threads);
+            return 1;
+        }
+        fprintf(stderr, "%2d threads: %d frames in %.1f ms, %.1f fps, %.2fx\n",
+            threads, stats.frames, ms, stats.frames * 1000.0 / ms, base_ms / ms);
+    }
+
+    Kit_FreeKeyframeIndex(index);
+    Kit_Quit();
+    SDL_Quit();
+    return 0;
+}
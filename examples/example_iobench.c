@@ -0,0 +1,101 @@
+#include <kitchensink/kitchensink.h>
+#include <libavformat/avformat.h>
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+/*
+* Measures demuxing throughput of many sources reading the same file at once,
+* with FFmpeg's own file protocol and with the queued (io_uring / pread) reader.
+* Each source stands in for one player; decoding is left out so that IO dominates.
+*
+* Note! This example does not do proper error handling etc.
+* It is for example use only!
+*/
+
+#define MAX_PLAYERS 256
+
+typedef struct Reader {
+    Kit_Source *src;
+    int64_t bytes;
+} Reader;
+
+static int read_all(void *ptr) {
+    Reader *reader = ptr;
+    AVFormatContext *format_ctx = reader->src->format_ctx;
+    AVPacket packet;
+    av_init_packet(&packet);
+    while(av_read_frame(format_ctx, &packet) >= 0) {
+        reader->bytes += packet.size;
+        av_packet_unref(&packet);
+    }
+    return 0;
+}
+
+static double run(const char *filename, int players, bool queued) {
+    Reader readers[MAX_PLAYERS];
+    SDL_Thread *threads[MAX_PLAYERS];
+    Kit_SourceOptions opts;
+    Kit_InitSourceOptions(&opts);
+    opts.queued_io = queued;
+
+    // Open everything first, so that only reading is timed
+    for(int i = 0; i < players; i++) {
+        readers[i].bytes = 0;
+        readers[i].src = Kit_CreateSourceFromUrlWithOptions(filename, &opts);
+        if(readers[i].src == NULL) {
+            fprintf(stderr, "Unable to open %s: %s\n", filename, Kit_GetError());
+            exit(1);
+        }
+    }
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    for(int i = 0; i < players; i++) {
+        threads[i] = SDL_CreateThread(read_all, "Reader", &readers[i]);
+    }
+    int64_t total = 0;
+    for(int i = 0; i < players; i++) {
+        SDL_WaitThread(threads[i], NULL);
+        total += readers[i].bytes;
+        Kit_CloseSource(readers[i].src);
+    }
+    double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+    return total / seconds / (1024.0 * 1024.0);
+}
+
+int main(int argc, char *argv[]) {
+    if(argc < 2) {
+        fprintf(stderr, "Usage: exampleiobench <filename> [players]\n");
+        return 0;
+    }
+    const char *filename = argv[1];
+    int players = (argc > 2) ? atoi(argv[2]) : 32;
+    if(players < 1 || players > MAX_PLAYERS) {
+        fprintf(stderr, "Player count must be between 1 and %d\n", MAX_PLAYERS);
+        return 1;
+    }
+
+    if(SDL_Init(0) != 0) {
+        fprintf(stderr, "Unable to initialize SDL!\n");
+        return 1;
+    }
+    if(Kit_Init(KIT_INIT_FORMATS) != 0) {
+        fprintf(stderr, "Unable to initialize Kitchensink: %s", Kit_GetError());
+        return 1;
+    }
+
+    // Run each twice, and report the second run; the first one warms up the page cache
+    for(int pass = 0; pass < 2; pass++) {
+        double plain = run(filename, players, false);
+        double queued = run(filename, players, true);
+        if(pass == 1) {
+            fprintf(stderr, "%d players, file protocol: %.1f MB/s\n", players, plain);
+            fprintf(stderr, "%d players, queued reader: %.1f MB/s\n", players, queued);
+        }
+    }
+
+    Kit_Quit();
+    SDL_Quit();
+    return 0;
+}
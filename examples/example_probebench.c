@@ -0,0 +1,75 @@
+#include <kitchensink/kitchensink.h>
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+/*
+* Measures how long opening a source takes with a full stream probe (cold), and with
+* the probe results restored from the on-disk probe cache (warm).
+*
+* Note! This example does not do proper error handling etc.
+* It is for example use only!
+*/
+
+static double open_source(const char *filename, const Kit_SourceOptions *opts, bool *from_cache) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    Kit_Source *src = Kit_CreateSourceFromUrlWithOptions(filename, opts);
+    double ms = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+    if(src == NULL) {
+        fprintf(stderr, "Unable to open %s: %s\n", filename, Kit_GetError());
+        exit(1);
+    }
+    *from_cache = src->from_probe_cache;
+    Kit_CloseSource(src);
+    return ms;
+}
+
+int main(int argc, char *argv[]) {
+    if(argc < 3) {
+        fprintf(stderr, "Usage: exampleprobebench <filename> <cache directory> [runs]\n");
+        return 0;
+    }
+    const char *filename = argv[1];
+    int runs = (argc > 3) ? atoi(argv[3]) : 20;
+    if(runs < 1) {
+        fprintf(stderr, "Run count must be at least 1\n");
+        return 1;
+    }
+
+    if(SDL_Init(0) != 0) {
+        fprintf(stderr, "Unable to initialize SDL!\n");
+        return 1;
+    }
+    if(Kit_Init(KIT_INIT_FORMATS) != 0) {
+        fprintf(stderr, "Unable to initialize Kitchensink: %s", Kit_GetError());
+        return 1;
+    }
+
+    Kit_SourceOptions cold;
+    Kit_InitSourceOptions(&cold);
+    Kit_SourceOptions warm = cold;
+    warm.cache_dir = argv[2];
+
+    // First open fills the cache if it is not there yet. This also warms up the page cache,
+    // so that both cases below read the file from memory and only probing differs.
+    bool from_cache;
+    open_source(filename, &warm, &from_cache);
+
+    double cold_ms = 0;
+    double warm_ms = 0;
+    for(int i = 0; i < runs; i++) {
+        cold_ms += open_source(filename, &cold, &from_cache);
+        warm_ms += open_source(filename, &warm, &from_cache);
+        if(!from_cache) {
+            fprintf(stderr, "Probe cache was not used; is %s a writable directory?\n", warm.cache_dir);
+            return 1;
+        }
+    }
+    fprintf(stderr, "Cold open (full probe): %.2f ms\n", cold_ms / runs);
+    fprintf(stderr, "Warm open (probe cache): %.2f ms\n", warm_ms / runs);
+
+    Kit_Quit();
+    SDL_Quit();
+    return 0;
+}
@@ -311,8 +311,8 @@ int main(int argc, char *argv[]) {
                     // Handle user clicking the progress bar
                     if(mouse_x >= 30 && mouse_x <= size_w-30 && mouse_y >= size_h - 60 && mouse_y <= size_h - 40) {
                         double pos = ((double)mouse_x - 30) / ((double)size_w - 60);
-                        double m_time = Kit_GetPlayerDuration(player) * pos - Kit_GetPlayerPosition(player);
-                        if(Kit_PlayerSeek(player, m_time) != 0) {
+                        double m_time = Kit_GetPlayerDuration(player) * pos;
+                        if(Kit_PlayerSeekTo(player, m_time) != 0) {
                             fprintf(stderr, "%s\n", Kit_GetError());
                         }
                     } else {
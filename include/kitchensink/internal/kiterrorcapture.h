@@ -0,0 +1,13 @@
+#ifndef KITERRORCAPTURE_H
+#define KITERRORCAPTURE_H
+
+#include <stddef.h>
+#include "kitchensink/kitconfig.h"
+
+/**
+ * Redirects errors set by the calling thread into buf, instead of the global error message.
+ * Worker threads use this to keep their errors apart from the application's. Pass NULL to stop.
+ */
+KIT_LOCAL void Kit_CaptureErrors(char *buf, size_t size);
+
+#endif // KITERRORCAPTURE_H
@@ -0,0 +1,37 @@
+#ifndef KITPACKETBUFFER_H
+#define KITPACKETBUFFER_H
+
+#include <libavcodec/avcodec.h>
+#include <stdbool.h>
+#include "kitchensink/kitconfig.h"
+
+typedef struct Kit_BufferedPacket {
+    AVPacket *packet; ///< FFmpeg: Reference to the demuxed packet
+    double pts; ///< Packet pts in seconds
+    bool is_anchor; ///< Playback can start from this packet (keyframe of the main stream)
+} Kit_BufferedPacket;
+
+/**
+ * Rolling window of demuxed packets, in demux order. Packets are appended at the end and
+ * dropped from the start once the window grows past its limits. A replay cursor can be
+ * placed inside the window; packets are then read back from it until the end is reached.
+ */
+typedef struct Kit_PacketBuffer {
+    Kit_BufferedPacket *packets;
+    int head; ///< Index of the oldest packet
+    int count; ///< Packets in the window
+    int capacity; ///< Allocated packet slots
+    int cursor; ///< Index of the next packet to replay, or -1 when not replaying
+    size_t bytes; ///< Payload bytes held
+    double max_seconds; ///< Time span limit, 0 for none
+    size_t max_bytes; ///< Payload size limit, 0 for none
+} Kit_PacketBuffer;
+
+KIT_LOCAL Kit_PacketBuffer* Kit_CreatePacketBuffer(double max_seconds, size_t max_bytes);
+KIT_LOCAL void Kit_DestroyPacketBuffer(Kit_PacketBuffer *buffer);
+KIT_LOCAL void Kit_ClearPacketBuffer(Kit_PacketBuffer *buffer);
+KIT_LOCAL int Kit_WritePacketBuffer(Kit_PacketBuffer *buffer, const AVPacket *packet, double pts, bool is_anchor);
+KIT_LOCAL int Kit_SeekPacketBuffer(Kit_PacketBuffer *buffer, double time);
+KIT_LOCAL int Kit_ReadPacketBuffer(Kit_PacketBuffer *buffer, AVPacket *packet);
+
+#endif // KITPACKETBUFFER_H
@@ -0,0 +1,10 @@
+#ifndef KITPROBECACHE_H
+#define KITPROBECACHE_H
+
+#include <libavformat/avformat.h>
+#include "kitchensink/kitconfig.h"
+
+KIT_LOCAL int Kit_LoadProbeCache(AVFormatContext *format_ctx, const char *cache_dir, const char *path);
+KIT_LOCAL int Kit_SaveProbeCache(const AVFormatContext *format_ctx, const char *cache_dir, const char *path);
+
+#endif // KITPROBECACHE_H
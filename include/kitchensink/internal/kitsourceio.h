@@ -0,0 +1,33 @@
+#ifndef KITSOURCEIO_H
+#define KITSOURCEIO_H
+
+#include <stdint.h>
+#include <libavformat/avformat.h>
+#include "kitchensink/kitconfig.h"
+#include "kitchensink/kitsource.h"
+
+// Size of the buffer FFmpeg reads custom IO sources through
+#define KIT_AVIO_BUFFERSIZE 32768
+
+typedef int (*Kit_SourceReadCallback)(void *opaque, uint8_t *buf, int size);
+typedef int64_t (*Kit_SourceSeekCallback)(void *opaque, int64_t offset, int whence);
+typedef void (*Kit_SourceCloseCallback)(void *opaque);
+
+KIT_LOCAL Kit_Source* Kit_OpenCustomSource(const char *url,
+                                           Kit_SourceReadCallback read_cb,
+                                           Kit_SourceSeekCallback seek_cb,
+                                           void *opaque,
+                                           Kit_SourceCloseCallback close_cb,
+                                           int buffer_size,
+                                           const Kit_SourceOptions *opts,
+                                           const AVIOInterruptCB *interrupt);
+
+// Interrupt callbacks, if given, are only used while the source is being opened
+KIT_LOCAL Kit_Source* Kit_OpenReadAheadSource(const char *url, const Kit_SourceOptions *opts,
+                                              const AVIOInterruptCB *interrupt);
+#ifndef _WIN32
+KIT_LOCAL Kit_Source* Kit_OpenQueuedFileSource(const char *path, const Kit_SourceOptions *opts,
+                                               const AVIOInterruptCB *interrupt);
+#endif
+
+#endif // KITSOURCEIO_H
@@ -0,0 +1,8 @@
+#ifndef KITTHUMBNAILCACHE_H
+#define KITTHUMBNAILCACHE_H
+
+#include "kitchensink/kitconfig.h"
+
+KIT_LOCAL void Kit_FreeThumbnailCache(void *cache);
+
+#endif // KITTHUMBNAILCACHE_H
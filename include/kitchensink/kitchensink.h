@@ -5,6 +5,8 @@
 #include "kitchensink/kiterror.h"
 #include "kitchensink/kitsource.h"
 #include "kitchensink/kitplayer.h"
+#include "kitchensink/kitthumbnail.h"
+#include "kitchensink/kitsegments.h"
 #include "kitchensink/kitutils.h"
 #include "kitchensink/kitconfig.h"
 
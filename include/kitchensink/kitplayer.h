@@ -24,6 +24,17 @@ typedef enum Kit_PlayerState {
     KIT_CLOSED ///< Playback is stopped and player is closing.
 } Kit_PlayerState;
 
+typedef enum Kit_SyncMaster {
+    KIT_SYNC_AUDIO = 0, ///< Clock follows the audio samples handed out by Kit_GetAudioData (default).
+    KIT_SYNC_VIDEO, ///< Clock follows the video frames handed out by Kit_GetVideoData.
+    KIT_SYNC_EXTERNAL ///< Clock follows system time.
+} Kit_SyncMaster;
+
+typedef enum Kit_SeekMode {
+    KIT_SEEK_KEYFRAME = 0, ///< Resume from the nearest keyframe; fast, but may land off the requested time (default).
+    KIT_SEEK_EXACT ///< Decode forward from the preceding keyframe, and resume at the requested time.
+} Kit_SeekMode;
+
 typedef struct Kit_AudioFormat {
     int stream_idx; ///< Stream index
     bool is_enabled; ///< Is stream enabled
@@ -55,9 +66,17 @@ typedef struct Kit_Player {
     Kit_SubtitleFormat sformat; ///< Subtitle format information
 
     // Synchronization
+    Kit_SyncMaster sync_master; ///< Selected master clock
+    double rate; ///< Playback rate, 1.0 being normal speed
+    double dec_rate; ///< Playback rate the decoders are currently set up for
     double clock_sync; ///< Clock sync point
     double pause_start; ///< Timestamp of pause beginning
     double vclock_pos; ///< Video stream last pts
+    double vclock_time; ///< System time of last video clock update, 0 if not valid
+    double aclock_pos; ///< Audio stream pts at the audio device output
+    double aclock_time; ///< System time of last audio clock update, 0 if not valid
+    double adrift; ///< Averaged audio drift against the master clock, in seconds
+    double adrift_comp; ///< Drift correction still waiting in the audio buffer, in seconds
 
     // Threading
     SDL_Thread *dec_thread; ///< Decoder thread
@@ -81,12 +100,56 @@ typedef struct Kit_Player {
     void *tmp_sframe; ///< FFmpeg: Preallocated temporary subtitle frame
     void *swr; ///< FFmpeg: Audio resampler
     void *sws; ///< FFmpeg: Video converter
+    void *afilter_graph; ///< FFmpeg: Audio time stretch filter graph, NULL at normal rate
+    void *afilter_src; ///< FFmpeg: Audio time stretch filter input
+    void *afilter_sink; ///< FFmpeg: Audio time stretch filter output
+    double afilter_pts; ///< Pts of the first sample fed to the time stretch filter
+    int64_t afilter_samples; ///< Samples received from the time stretch filter so far
 
     // libass
     void *ass_renderer;
     void *ass_track;
 
+    // Seeking
+    Kit_SeekMode seek_mode; ///< Selected seek mode
+    double vseek_target; ///< Video frames ending before this pts are dropped, negative if none
+    double aseek_target; ///< Audio samples before this pts are dropped, negative if none
+    double seek_start; ///< System time the pending seek was started, 0 if none
+    double seek_time; ///< Time the last seek took to produce its first frame, in seconds
+    double seek_pos; ///< Absolute position of the last seek
+    double seek_request; ///< Absolute position of the latest requested seek, protected by cmutex
+    bool scrubbing; ///< Scrubbing requested by the application
+    bool dec_scrubbing; ///< Scrubbing the decoders are currently set up for
+    bool preview_flag; ///< Seeked while paused; the first new frame is shown anyway, protected by vmutex
+
+    // Packet window
+    void *dvr; ///< Rolling buffer of demuxed packets for in-memory seeks, NULL if disabled
+    double dvr_seconds; ///< Requested window length in seconds, 0 for no limit, protected by cmutex
+    int dvr_megabytes; ///< Requested window size in megabytes, 0 for no limit, protected by cmutex
+    bool dvr_changed; ///< Window settings are waiting for the decoder thread, protected by cmutex
+
+    // A-B loop
+    double loop_req_start; ///< Requested loop start, protected by cmutex
+    double loop_req_end; ///< Requested loop end, 0 to stop looping, protected by cmutex
+    bool loop_changed; ///< Loop request is waiting for the decoder thread, protected by cmutex
+    double loop_start; ///< Active loop start
+    double loop_end; ///< Active loop end, 0 if not looping
+    double loop_offset; ///< Added to stream timestamps; grows by the loop length on every pass
+    void *loop_cache; ///< Decoded frames of the loop segment
+    int loop_cache_megabytes; ///< Memory limit for recording the loop segments set from now on, protected by cmutex
+
+    // Playlist
+    void *next_item; ///< Source queued to play after the current one, protected by cmutex
+    void *preread; ///< Packets of the current source demuxed before it took over, NULL once all are decoded
+    bool looping; ///< Restart from the beginning when the source ends
+    double item_offset; ///< Added to stream timestamps of the source being decoded
+    double prev_item_offset; ///< Offset of the previous source, while its last frames are still playing
+    double item_base; ///< Timestamp the source being decoded starts at, with offsets
+    double item_end; ///< Largest end timestamp decoded from the current source, without offsets
+
     // Other
+    int (*src_interrupt)(void*); ///< Interrupt callback the source had before the player took it over
+    void *src_interrupt_opaque; ///< Userdata of src_interrupt
     uint8_t seek_flag;
     const Kit_Source *src; ///< Reference to Audio/Video source
 } Kit_Player;
@@ -108,6 +171,8 @@ KIT_API void Kit_ClosePlayer(Kit_Player *player);
 
 KIT_API int Kit_UpdatePlayer(Kit_Player *player);
 KIT_API int Kit_GetVideoData(Kit_Player *player, SDL_Texture *texture);
+KIT_API int Kit_GetVideoDataForDisplay(Kit_Player *player, SDL_Texture *texture, double display_delay);
+KIT_API int Kit_GetNextVideoFrameTime(Kit_Player *player, double *pts, double *delay);
 KIT_API int Kit_GetSubtitleData(Kit_Player *player, SDL_Renderer *renderer);
 KIT_API int Kit_GetAudioData(Kit_Player *player, unsigned char *buffer, int length, int cur_buf_len);
 KIT_API void Kit_GetPlayerInfo(const Kit_Player *player, Kit_PlayerInfo *info);
@@ -117,7 +182,27 @@ KIT_API void Kit_PlayerPlay(Kit_Player *player);
 KIT_API void Kit_PlayerStop(Kit_Player *player);
 KIT_API void Kit_PlayerPause(Kit_Player *player);
 
+KIT_API void Kit_SetPlayerSyncMaster(Kit_Player *player, Kit_SyncMaster master);
+KIT_API Kit_SyncMaster Kit_GetPlayerSyncMaster(const Kit_Player *player);
+
+KIT_API int Kit_SetPlaybackRate(Kit_Player *player, double rate);
+KIT_API double Kit_GetPlaybackRate(const Kit_Player *player);
+
 KIT_API int Kit_PlayerSeek(Kit_Player *player, double time);
+KIT_API int Kit_PlayerSeekTo(Kit_Player *player, double time);
+KIT_API void Kit_SetPlayerSeekMode(Kit_Player *player, Kit_SeekMode mode);
+KIT_API Kit_SeekMode Kit_GetPlayerSeekMode(const Kit_Player *player);
+KIT_API double Kit_GetPlayerSeekTime(const Kit_Player *player);
+KIT_API void Kit_SetPlayerScrubbing(Kit_Player *player, bool scrubbing);
+KIT_API bool Kit_IsPlayerScrubbing(const Kit_Player *player);
+KIT_API int Kit_SetPlayerDvrWindow(Kit_Player *player, double seconds, int megabytes);
+KIT_API int Kit_SetPlayerLoopSegment(Kit_Player *player, double start, double end);
+KIT_API int Kit_ClearPlayerLoopSegment(Kit_Player *player);
+KIT_API int Kit_SetPlayerLoopCacheSize(Kit_Player *player, int megabytes);
+KIT_API bool Kit_IsPlayerLoopCached(const Kit_Player *player);
+KIT_API int Kit_QueuePlayerSource(Kit_Player *player, const Kit_Source *src);
+KIT_API void Kit_SetPlayerLooping(Kit_Player *player, bool looping);
+KIT_API bool Kit_IsPlayerLooping(const Kit_Player *player);
 KIT_API double Kit_GetPlayerDuration(const Kit_Player *player);
 KIT_API double Kit_GetPlayerPosition(const Kit_Player *player);
 
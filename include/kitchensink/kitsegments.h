@@ -0,0 +1,27 @@
+#ifndef KITSEGMENTS_H
+#define KITSEGMENTS_H
+
+#include "kitchensink/kitsource.h"
+#include "kitchensink/kitconfig.h"
+
+#include <SDL2/SDL_surface.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Receives decoded frames in presentation order. The surface is owned by the library and only
+ * valid until the callback returns. Return nonzero to stop decoding.
+ */
+typedef int (*Kit_DecodedFrameCallback)(SDL_Surface *frame, double pts, void *userdata);
+
+KIT_API int Kit_DecodeFileParallel(const char *path, const Kit_KeyframeIndex *index,
+                                   int width, int height, int threads,
+                                   Kit_DecodedFrameCallback frame_cb, void *userdata);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KITSEGMENTS_H
@@ -3,12 +3,18 @@
 
 #include "kitchensink/kitconfig.h"
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #define KIT_CODECNAMESIZE 32
 #define KIT_CODECLONGNAMESIZE 128
+#define KIT_ASYNCERRORSIZE 256
+#define KIT_PROBEMAXSTREAMS 8
+#define KIT_PROBEERRORSIZE 256
 
 typedef enum Kit_StreamType {
     KIT_STREAMTYPE_UNKNOWN, ///< Unknown stream type
@@ -19,11 +25,28 @@ typedef enum Kit_StreamType {
     KIT_STREAMTYPE_ATTACHMENT ///< Attachment stream (images, etc)
 } Kit_StreamType;
 
+typedef struct Kit_KeyframeIndex {
+    int stream_idx; ///< Stream the keyframes belong to
+    int tb_num; ///< Stream time base numerator
+    int tb_den; ///< Stream time base denominator
+    int count; ///< Number of keyframes
+    int capacity; ///< Allocated size of pts and pos
+    int64_t *pts; ///< Keyframe timestamps in stream time base, ascending
+    int64_t *pos; ///< Byte offsets of the keyframe packets
+} Kit_KeyframeIndex;
+
 typedef struct Kit_Source {
     int astream_idx; ///< Audio stream index
     int vstream_idx; ///< Video stream index
     int sstream_idx; ///< Subtitle stream index
     void *format_ctx; ///< FFmpeg: Videostream format context
+    bool is_live; ///< Live source; players keep latency minimal and drop data to catch up
+    bool from_probe_cache; ///< Stream information was restored from the probe cache instead of probed
+    void *avio_ctx; ///< FFmpeg: Custom IO context, NULL if FFmpeg handles IO by itself
+    void *io_opaque; ///< State for the custom IO callbacks
+    void (*io_close)(void *opaque); ///< Releases io_opaque when the source is closed
+    const Kit_KeyframeIndex *keyframe_index; ///< Keyframe index used for seeking, or NULL. Not owned.
+    void *thumb_cache; ///< Thumbnail extraction state, created on first use
 } Kit_Source;
 
 typedef struct Kit_Stream {
@@ -31,15 +54,133 @@ typedef struct Kit_Stream {
     Kit_StreamType type; ///< Stream type
 } Kit_StreamInfo;
 
+typedef struct Kit_SourceOptions {
+    int64_t probesize; ///< Maximum bytes read while probing the source, 0 for FFmpeg default
+    int64_t analyzeduration; ///< Maximum stream duration (in microseconds) analyzed, 0 for FFmpeg default
+    const char *format; ///< Container format hint (eg. "matroska"), NULL to autodetect
+    bool skip_stream_info; ///< Trust container headers and skip stream analysis entirely
+    bool is_live; ///< Open as a live source (see Kit_CreateLiveSourceFromUrl)
+    const char *cache_dir; ///< Directory for cached stream information of local files, NULL to disable
+    int readahead_mb; ///< Megabytes to keep buffered ahead of the demuxer on a background thread, 0 to disable
+    bool queued_io; ///< Read local files with several requests in flight (io_uring if available, pread otherwise)
+} Kit_SourceOptions;
+
+typedef enum Kit_AsyncSourceState {
+    KIT_ASYNC_PENDING = 0, ///< Source is still being opened
+    KIT_ASYNC_READY, ///< Source is open, and can be taken with Kit_TakeAsyncSource
+    KIT_ASYNC_FAILED, ///< Source could not be opened; see Kit_GetAsyncSourceError
+    KIT_ASYNC_CANCELLED ///< Opening was cancelled before it finished
+} Kit_AsyncSourceState;
+
+typedef struct Kit_AsyncSource Kit_AsyncSource;
+
+/**
+ * Called from the opening thread once the handle leaves the pending state.
+ * Kit_TakeAsyncSource may be called here, but Kit_CloseAsyncSource must not.
+ */
+typedef void (*Kit_AsyncSourceCallback)(Kit_AsyncSource *handle, Kit_AsyncSourceState state, void *userdata);
+
+struct Kit_AsyncSource {
+    Kit_AsyncSourceState state; ///< Current state, read with Kit_GetAsyncSourceState
+    Kit_Source *src; ///< Opened source, until taken by the caller
+    char *url; ///< Copy of the source url
+    Kit_SourceOptions opts; ///< Copy of the options; strings point to own copies
+    Kit_AsyncSourceCallback cb; ///< Completion callback, or NULL
+    void *userdata; ///< Userdata for the completion callback
+    bool cancelled; ///< Cancellation has been requested
+    char error[KIT_ASYNCERRORSIZE]; ///< Error message if opening failed
+    void *thread; ///< SDL: Opening thread
+    void *lock; ///< SDL: Lock for state, src and cancelled
+};
+
+typedef struct Kit_ProbeStreamInfo {
+    int index; ///< Stream index
+    Kit_StreamType type; ///< Stream type
+    char codec_name[KIT_CODECNAMESIZE]; ///< Short codec name (eg. "h264")
+    int width; ///< Video width in pixels, 0 if not video
+    int height; ///< Video height in pixels, 0 if not video
+    int samplerate; ///< Audio samplerate, 0 if not audio
+    int channels; ///< Audio channel count, 0 if not audio
+} Kit_ProbeStreamInfo;
+
+typedef struct Kit_ProbeResult {
+    int error; ///< 0 if the file was probed successfully, 1 otherwise
+    char error_message[KIT_PROBEERRORSIZE]; ///< Reason the file could not be probed, empty on success
+    double duration; ///< Duration in seconds, or -1 if unknown
+    char format_name[KIT_CODECNAMESIZE]; ///< Container format name
+    int stream_count; ///< Total number of streams in the file
+    Kit_ProbeStreamInfo streams[KIT_PROBEMAXSTREAMS]; ///< Information about the first streams
+} Kit_ProbeResult;
+
+/**
+ * Custom IO callbacks. Read returns the number of bytes read, 0 at end of stream or negative on error.
+ * Seek takes SEEK_SET, SEEK_CUR or SEEK_END and returns the new position, or negative on error.
+ * Size returns the total stream size in bytes, or negative if unknown.
+ */
+typedef int (*Kit_ReadCallback)(void *userdata, unsigned char *buf, int size);
+typedef int64_t (*Kit_SeekCallback)(void *userdata, int64_t offset, int whence);
+typedef int64_t (*Kit_SizeCallback)(void *userdata);
+
+/**
+ * Memory buffer that is filled while a source is already reading from it. Reads past the
+ * received data block until more is appended, or until the buffer is finished or aborted.
+ * Freeing the buffer only releases the application's reference, so finish or abort it first
+ * if sources may still be reading.
+ */
+typedef struct Kit_GrowingBuffer {
+    unsigned char *data; ///< Received bytes
+    size_t length; ///< Number of bytes received so far
+    size_t capacity; ///< Allocated size of data
+    int64_t total_size; ///< Final size if known up front, -1 otherwise
+    bool finished; ///< No more data will be appended
+    bool aborted; ///< Download was given up; waiting reads fail instead of blocking
+    int refs; ///< Owners; the application, plus each source reading from the buffer
+    void *lock; ///< SDL: Lock for all of the above
+    void *cond; ///< SDL: Signalled when data is appended or the buffer is finished
+} Kit_GrowingBuffer;
+
 typedef struct cached_file {
 	unsigned char * file_pointer;
 	size_t filesize;
 } cached_file;
 
 KIT_API Kit_Source* Kit_CreateSourceFromUrl(const char *path);
+KIT_API Kit_Source* Kit_CreateLiveSourceFromUrl(const char *path);
 KIT_API Kit_Source* Kit_CreateSourceFromMemory(cached_file * cf);
+KIT_API void Kit_InitSourceOptions(Kit_SourceOptions *opts);
+KIT_API Kit_Source* Kit_CreateSourceFromUrlWithOptions(const char *path, const Kit_SourceOptions *opts);
+KIT_API Kit_Source* Kit_CreateSourceFromMemoryWithOptions(cached_file * cf, const Kit_SourceOptions *opts);
+KIT_API Kit_Source* Kit_CreateSourceFromMappedFile(const char *path);
+KIT_API Kit_GrowingBuffer* Kit_CreateGrowingBuffer(int64_t total_size);
+KIT_API int Kit_AppendGrowingBuffer(Kit_GrowingBuffer *buffer, const void *data, size_t len);
+KIT_API void Kit_FinishGrowingBuffer(Kit_GrowingBuffer *buffer);
+KIT_API void Kit_AbortGrowingBuffer(Kit_GrowingBuffer *buffer);
+KIT_API void Kit_FreeGrowingBuffer(Kit_GrowingBuffer *buffer);
+KIT_API Kit_Source* Kit_CreateSourceFromGrowingBuffer(Kit_GrowingBuffer *buffer, const Kit_SourceOptions *opts);
+KIT_API Kit_Source* Kit_CreateSourceFromCallbacks(Kit_ReadCallback read_cb,
+                                                  Kit_SeekCallback seek_cb,
+                                                  Kit_SizeCallback size_cb,
+                                                  void *userdata,
+                                                  int buffer_size);
 KIT_API void Kit_CloseSource(Kit_Source *src);
 
+KIT_API Kit_AsyncSource* Kit_CreateSourceAsync(const char *path, const Kit_SourceOptions *opts,
+                                               Kit_AsyncSourceCallback cb, void *userdata);
+KIT_API Kit_AsyncSourceState Kit_GetAsyncSourceState(Kit_AsyncSource *handle);
+KIT_API const char* Kit_GetAsyncSourceError(Kit_AsyncSource *handle);
+KIT_API Kit_Source* Kit_TakeAsyncSource(Kit_AsyncSource *handle);
+KIT_API void Kit_CancelAsyncSource(Kit_AsyncSource *handle);
+KIT_API void Kit_CloseAsyncSource(Kit_AsyncSource *handle);
+
+KIT_API Kit_KeyframeIndex* Kit_BuildKeyframeIndex(const char *path, int stream_idx);
+KIT_API Kit_KeyframeIndex* Kit_LoadKeyframeIndex(const char *path);
+KIT_API int Kit_SaveKeyframeIndex(const Kit_KeyframeIndex *index, const char *path);
+KIT_API void Kit_FreeKeyframeIndex(Kit_KeyframeIndex *index);
+KIT_API int Kit_SetSourceKeyframeIndex(Kit_Source *src, const Kit_KeyframeIndex *index);
+KIT_API int Kit_FindKeyframe(const Kit_KeyframeIndex *index, double time);
+
+KIT_API int Kit_ProbeFiles(const char **paths, int count, Kit_ProbeResult *results, int threads);
+
 KIT_API int Kit_GetSourceStreamInfo(const Kit_Source *src, Kit_StreamInfo *info, int index);
 KIT_API int Kit_GetSourceStreamCount(const Kit_Source *src);
 KIT_API int Kit_GetBestSourceStream(const Kit_Source *src, const Kit_StreamType type);
@@ -0,0 +1,20 @@
+#ifndef KITTHUMBNAIL_H
+#define KITTHUMBNAIL_H
+
+#include "kitchensink/kitsource.h"
+#include "kitchensink/kitconfig.h"
+
+#include <SDL2/SDL_surface.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+KIT_API SDL_Surface* Kit_ExtractThumbnail(Kit_Source *src, double time, int width, int height);
+KIT_API void Kit_GetThumbnailCacheStats(const Kit_Source *src, unsigned int *hits, unsigned int *misses);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KITTHUMBNAIL_H
@@ -1,4 +1,8 @@
 #include "kitchensink/kitchensink.h"
+#include "kitchensink/internal/kiterrorcapture.h"
+
+#include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_atomic.h>
 
 #include <stdlib.h>
 #include <stdarg.h>
@@ -11,6 +15,48 @@
 static char _error_available = false;
 static char _error_message[KIT_ERRBUFSIZE] = "\0";
 
+typedef struct Kit_ErrorCapture {
+    char *buf;
+    size_t size;
+} Kit_ErrorCapture;
+
+// Thread local capture target, created when the first thread asks for one
+static SDL_SpinLock _capture_lock = 0;
+static SDL_TLSID _capture_tls = 0;
+
+static Kit_ErrorCapture* _GetErrorCapture() {
+    SDL_AtomicLock(&_capture_lock);
+    SDL_TLSID tls = _capture_tls;
+    SDL_AtomicUnlock(&_capture_lock);
+    return tls != 0 ? SDL_TLSGet(tls) : NULL;
+}
+
+void Kit_CaptureErrors(char *buf, size_t size) {
+    SDL_AtomicLock(&_capture_lock);
+    if(_capture_tls == 0) {
+        _capture_tls = SDL_TLSCreate();
+    }
+    SDL_TLSID tls = _capture_tls;
+    SDL_AtomicUnlock(&_capture_lock);
+
+    Kit_ErrorCapture *capture = SDL_TLSGet(tls);
+    if(buf == NULL) {
+        SDL_TLSSet(tls, NULL, NULL);
+        free(capture);
+        return;
+    }
+    if(capture == NULL) {
+        capture = malloc(sizeof(Kit_ErrorCapture));
+        if(capture == NULL || SDL_TLSSet(tls, capture, free) != 0) {
+            free(capture);
+            return;
+        }
+    }
+    capture->buf = buf;
+    capture->size = size;
+    buf[0] = 0;
+}
+
 const char* Kit_GetError() {
     if(_error_available) {
         _error_available = false;
@@ -23,6 +69,12 @@ void Kit_SetError(const char* fmt, ...) {
     assert(fmt != NULL);
     va_list args;
     va_start(args, fmt);
+    Kit_ErrorCapture *capture = _GetErrorCapture();
+    if(capture != NULL) {
+        vsnprintf(capture->buf, capture->size, (char*)fmt, args);
+        va_end(args);
+        return;
+    }
     vsnprintf(_error_message, KIT_ERRBUFSIZE, (char*)fmt, args);
     va_end(args);
     _error_available = true;
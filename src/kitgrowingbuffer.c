@@ -0,0 +1,231 @@
+#include "kitchensink/kitsource.h"
+#include "kitchensink/kiterror.h"
+#include "kitchensink/internal/kitsourceio.h"
+
+#include <libavformat/avformat.h>
+
+#include <SDL2/SDL_mutex.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+// Initial allocation when the final size is not known
+#define KIT_GROWING_INITIAL_CAPACITY (1024 * 1024)
+
+// How often a read waiting for data checks whether it should give up
+#define KIT_GROWING_POLL_MS 10
+
+typedef struct Kit_GrowingReader {
+    Kit_GrowingBuffer *buffer; ///< Shared buffer; one reference is held by the reader
+    int64_t pos; ///< Read position of this source
+    const AVIOInterruptCB *interrupt; ///< Interrupt callback of the source format context, once open
+} Kit_GrowingReader;
+
+static void _ReleaseGrowingBuffer(Kit_GrowingBuffer *buffer) {
+    SDL_LockMutex(buffer->lock);
+    int refs = --buffer->refs;
+    SDL_UnlockMutex(buffer->lock);
+    if(refs > 0) {
+        return;
+    }
+    SDL_DestroyCond(buffer->cond);
+    SDL_DestroyMutex(buffer->lock);
+    free(buffer->data);
+    free(buffer);
+}
+
+Kit_GrowingBuffer* Kit_CreateGrowingBuffer(int64_t total_size) {
+    Kit_GrowingBuffer *buffer = calloc(1, sizeof(Kit_GrowingBuffer));
+    if(buffer == NULL) {
+        Kit_SetError("Unable to allocate growing buffer");
+        return NULL;
+    }
+    buffer->total_size = total_size >= 0 ? total_size : -1;
+    buffer->capacity = total_size > 0 ? (size_t)total_size : KIT_GROWING_INITIAL_CAPACITY;
+    buffer->refs = 1;
+    buffer->data = malloc(buffer->capacity);
+    if(buffer->data == NULL) {
+        Kit_SetError("Unable to allocate growing buffer");
+        goto exit_0;
+    }
+    buffer->lock = SDL_CreateMutex();
+    if(buffer->lock == NULL) {
+        Kit_SetError("Unable to allocate growing buffer mutex");
+        goto exit_1;
+    }
+    buffer->cond = SDL_CreateCond();
+    if(buffer->cond == NULL) {
+        Kit_SetError("Unable to allocate growing buffer condition");
+        goto exit_2;
+    }
+    return buffer;
+
+exit_2:
+    SDL_DestroyMutex(buffer->lock);
+exit_1:
+    free(buffer->data);
+exit_0:
+    free(buffer);
+    return NULL;
+}
+
+int Kit_AppendGrowingBuffer(Kit_GrowingBuffer *buffer, const void *data, size_t len) {
+    assert(buffer != NULL);
+    assert(data != NULL || len == 0);
+    int ret = 0;
+
+    SDL_LockMutex(buffer->lock);
+    if(buffer->finished || buffer->aborted) {
+        Kit_SetError("Growing buffer is already finished");
+        ret = 1;
+        goto exit_0;
+    }
+    if(buffer->length + len > buffer->capacity) {
+        size_t capacity = buffer->capacity;
+        while(capacity < buffer->length + len) {
+            capacity *= 2;
+        }
+        unsigned char *grown = realloc(buffer->data, capacity);
+        if(grown == NULL) {
+            Kit_SetError("Unable to grow buffer to %zu bytes", capacity);
+            ret = 1;
+            goto exit_0;
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->length, data, len);
+    buffer->length += len;
+    SDL_CondBroadcast(buffer->cond);
+
+exit_0:
+    SDL_UnlockMutex(buffer->lock);
+    return ret;
+}
+
+void Kit_FinishGrowingBuffer(Kit_GrowingBuffer *buffer) {
+    assert(buffer != NULL);
+    SDL_LockMutex(buffer->lock);
+    buffer->finished = true;
+    SDL_CondBroadcast(buffer->cond);
+    SDL_UnlockMutex(buffer->lock);
+}
+
+void Kit_AbortGrowingBuffer(Kit_GrowingBuffer *buffer) {
+    assert(buffer != NULL);
+    SDL_LockMutex(buffer->lock);
+    buffer->aborted = true;
+    SDL_CondBroadcast(buffer->cond);
+    SDL_UnlockMutex(buffer->lock);
+}
+
+void Kit_FreeGrowingBuffer(Kit_GrowingBuffer *buffer) {
+    if(buffer == NULL) return;
+
+    // Only drops the application's reference. Whether the download is complete is up to
+    // Kit_FinishGrowingBuffer and Kit_AbortGrowingBuffer; sources still reading see no change.
+    _ReleaseGrowingBuffer(buffer);
+}
+
+static int _GrowingRead(void *opaque, uint8_t *buf, int size) {
+    Kit_GrowingReader *reader = opaque;
+    Kit_GrowingBuffer *buffer = reader->buffer;
+    int ret;
+
+    // A stalled download must not hold up whoever is closing the source (eg. a player
+    // joining its decoder thread), so keep checking the interrupt callback while waiting.
+    SDL_LockMutex(buffer->lock);
+    while(reader->pos >= (int64_t)buffer->length && !buffer->finished && !buffer->aborted) {
+        const AVIOInterruptCB *interrupt = reader->interrupt;
+        if(interrupt != NULL && interrupt->callback != NULL && interrupt->callback(interrupt->opaque)) {
+            SDL_UnlockMutex(buffer->lock);
+            return AVERROR_EXIT;
+        }
+        SDL_CondWaitTimeout(buffer->cond, buffer->lock, KIT_GROWING_POLL_MS);
+    }
+    int64_t left = (int64_t)buffer->length - reader->pos;
+    if(buffer->aborted && left <= 0) {
+        ret = AVERROR_EXIT;
+    } else if(left <= 0) {
+        ret = AVERROR_EOF;
+    } else {
+        ret = (size > left) ? left : size;
+        memcpy(buf, buffer->data + reader->pos, ret);
+        reader->pos += ret;
+    }
+    SDL_UnlockMutex(buffer->lock);
+    return ret;
+}
+
+static int64_t _GrowingSeek(void *opaque, int64_t offset, int whence) {
+    Kit_GrowingReader *reader = opaque;
+    Kit_GrowingBuffer *buffer = reader->buffer;
+    int64_t pos;
+
+    // Size is known if the application told us, or once everything has arrived
+    SDL_LockMutex(buffer->lock);
+    int64_t size = buffer->total_size;
+    if(size < 0 && buffer->finished) {
+        size = buffer->length;
+    }
+    SDL_UnlockMutex(buffer->lock);
+
+    switch(whence & ~AVSEEK_FORCE) {
+        case AVSEEK_SIZE: return size >= 0 ? size : AVERROR(ENOSYS);
+        case SEEK_SET: pos = offset; break;
+        case SEEK_CUR: pos = reader->pos + offset; break;
+        case SEEK_END:
+            if(size < 0) {
+                return AVERROR(ENOSYS);
+            }
+            pos = size + offset;
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+    if(pos < 0 || (size >= 0 && pos > size)) {
+        return AVERROR(EINVAL);
+    }
+
+    // Positions already received are served right away; later ones wait in the read callback
+    reader->pos = pos;
+    return pos;
+}
+
+static void _GrowingClose(void *opaque) {
+    Kit_GrowingReader *reader = opaque;
+    _ReleaseGrowingBuffer(reader->buffer);
+    free(reader);
+}
+
+Kit_Source* Kit_CreateSourceFromGrowingBuffer(Kit_GrowingBuffer *buffer, const Kit_SourceOptions *opts) {
+    assert(buffer != NULL);
+
+    Kit_GrowingReader *reader = calloc(1, sizeof(Kit_GrowingReader));
+    if(reader == NULL) {
+        Kit_SetError("Unable to allocate growing buffer reader");
+        return NULL;
+    }
+    reader->buffer = buffer;
+    SDL_LockMutex(buffer->lock);
+    buffer->refs++;
+    SDL_UnlockMutex(buffer->lock);
+
+    Kit_SourceOptions defaults;
+    if(opts == NULL) {
+        Kit_InitSourceOptions(&defaults);
+        opts = &defaults;
+    }
+
+    // Opening reads the container headers, so this blocks until enough data has been appended,
+    // or until the buffer is aborted
+    Kit_Source *src = Kit_OpenCustomSource(NULL, _GrowingRead, _GrowingSeek, reader, _GrowingClose,
+                                           KIT_AVIO_BUFFERSIZE, opts, NULL);
+    if(src != NULL) {
+        reader->interrupt = &((AVFormatContext *)src->format_ctx)->interrupt_callback;
+    }
+    return src;
+}
@@ -0,0 +1,322 @@
+#include "kitchensink/kitsource.h"
+#include "kitchensink/kiterror.h"
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#define KIT_KEYFRAME_MAGIC "KKI1"
+#define KIT_KEYFRAME_INITIAL_CAPACITY 256
+
+static int _AddKeyframe(Kit_KeyframeIndex *index, int64_t pts, int64_t pos) {
+    if(index->count == index->capacity) {
+        int capacity = index->capacity > 0 ? index->capacity * 2 : KIT_KEYFRAME_INITIAL_CAPACITY;
+        int64_t *new_pts = realloc(index->pts, capacity * sizeof(int64_t));
+        if(new_pts == NULL) {
+            return 1;
+        }
+        index->pts = new_pts;
+        int64_t *new_pos = realloc(index->pos, capacity * sizeof(int64_t));
+        if(new_pos == NULL) {
+            return 1;
+        }
+        index->pos = new_pos;
+        index->capacity = capacity;
+    }
+    index->pts[index->count] = pts;
+    index->pos[index->count] = pos;
+    index->count++;
+    return 0;
+}
+
+static int _CompareKeyframes(const void *a, const void *b) {
+    int64_t x = *(const int64_t*)a;
+    int64_t y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+Kit_KeyframeIndex* Kit_BuildKeyframeIndex(const char *path, int stream_idx) {
+    assert(path != NULL);
+    AVFormatContext *format_ctx = NULL;
+    AVPacket packet;
+
+    Kit_KeyframeIndex *index = calloc(1, sizeof(Kit_KeyframeIndex));
+    if(index == NULL) {
+        Kit_SetError("Unable to allocate keyframe index");
+        return NULL;
+    }
+
+    // Use a private format context, so that sources in use by players are never disturbed
+    if(avformat_open_input(&format_ctx, path, NULL, NULL) < 0) {
+        Kit_SetError("Unable to open source Url");
+        goto exit_0;
+    }
+    if(avformat_find_stream_info(format_ctx, NULL) < 0) {
+        Kit_SetError("Unable to fetch source information");
+        goto exit_1;
+    }
+    if(stream_idx < 0) {
+        stream_idx = av_find_best_stream(format_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    }
+    if(stream_idx < 0 || stream_idx >= (int)format_ctx->nb_streams) {
+        Kit_SetError("Invalid stream index");
+        goto exit_1;
+    }
+
+    // Only packet headers are needed; everything else can be skipped by the demuxer
+    for(unsigned int i = 0; i < format_ctx->nb_streams; i++) {
+        format_ctx->streams[i]->discard = ((int)i == stream_idx) ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    }
+    AVStream *stream = format_ctx->streams[stream_idx];
+    index->stream_idx = stream_idx;
+    index->tb_num = stream->time_base.num;
+    index->tb_den = stream->time_base.den;
+
+    av_init_packet(&packet);
+    while(av_read_frame(format_ctx, &packet) >= 0) {
+        int64_t pts = (packet.pts != AV_NOPTS_VALUE) ? packet.pts : packet.dts;
+        if(packet.stream_index == stream_idx
+            && (packet.flags & AV_PKT_FLAG_KEY)
+            && packet.pos >= 0
+            && pts != AV_NOPTS_VALUE) {
+            if(_AddKeyframe(index, pts, packet.pos) != 0) {
+                Kit_SetError("Unable to grow keyframe index");
+                av_packet_unref(&packet);
+                goto exit_1;
+            }
+        }
+        av_packet_unref(&packet);
+    }
+
+    // Keyframes are normally found in order, but make sure lookups can bisect. Positions
+    // follow their timestamps, so sort pairs by packing them side by side first.
+    bool sorted = true;
+    for(int i = 1; i < index->count; i++) {
+        if(index->pts[i] < index->pts[i - 1]) {
+            sorted = false;
+            break;
+        }
+    }
+    if(!sorted) {
+        int64_t *pairs = malloc(index->count * 2 * sizeof(int64_t));
+        if(pairs == NULL) {
+            Kit_SetError("Unable to sort keyframe index");
+            goto exit_1;
+        }
+        for(int i = 0; i < index->count; i++) {
+            pairs[i * 2] = index->pts[i];
+            pairs[i * 2 + 1] = index->pos[i];
+        }
+        qsort(pairs, index->count, 2 * sizeof(int64_t), _CompareKeyframes);
+        for(int i = 0; i < index->count; i++) {
+            index->pts[i] = pairs[i * 2];
+            index->pos[i] = pairs[i * 2 + 1];
+        }
+        free(pairs);
+    }
+
+    avformat_close_input(&format_ctx);
+    return index;
+
+exit_1:
+    avformat_close_input(&format_ctx);
+exit_0:
+    Kit_FreeKeyframeIndex(index);
+    return NULL;
+}
+
+void Kit_FreeKeyframeIndex(Kit_KeyframeIndex *index) {
+    if(index == NULL) return;
+    free(index->pts);
+    free(index->pos);
+    free(index);
+}
+
+int Kit_FindKeyframe(const Kit_KeyframeIndex *index, double time) {
+    assert(index != NULL);
+    if(index->count == 0 || index->tb_num <= 0 || index->tb_den <= 0) {
+        return -1;
+    }
+
+    // Last keyframe at or before the requested time
+    int64_t target = time * index->tb_den / index->tb_num;
+    int lo = 0;
+    int hi = index->count - 1;
+    if(index->pts[0] > target) {
+        return 0;
+    }
+    while(lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if(index->pts[mid] <= target) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+int Kit_SetSourceKeyframeIndex(Kit_Source *src, const Kit_KeyframeIndex *index) {
+    assert(src != NULL);
+    if(index != NULL) {
+        AVFormatContext *format_ctx = (AVFormatContext *)src->format_ctx;
+        if(index->stream_idx < 0 || index->stream_idx >= (int)format_ctx->nb_streams) {
+            Kit_SetError("Keyframe index does not match the source");
+            return 1;
+        }
+        AVStream *stream = format_ctx->streams[index->stream_idx];
+        if(stream->time_base.num != index->tb_num || stream->time_base.den != index->tb_den) {
+            Kit_SetError("Keyframe index does not match the source");
+            return 1;
+        }
+    }
+    src->keyframe_index = index;
+    return 0;
+}
+
+// Sidecar format: magic, then header and entries as LEB128 varints. Timestamps and positions
+// are stored as zigzag coded deltas to the previous entry, which keeps most entries at 2-4 bytes.
+
+static int _WriteVarint(FILE *fp, uint64_t value) {
+    unsigned char buf[10];
+    int len = 0;
+    do {
+        buf[len] = value & 0x7F;
+        value >>= 7;
+        if(value) {
+            buf[len] |= 0x80;
+        }
+        len++;
+    } while(value);
+    return fwrite(buf, 1, len, fp) != (size_t)len;
+}
+
+static int _ReadVarint(FILE *fp, uint64_t *value) {
+    *value = 0;
+    for(int shift = 0; shift < 64; shift += 7) {
+        int c = fgetc(fp);
+        if(c == EOF) {
+            return 1;
+        }
+        *value |= (uint64_t)(c & 0x7F) << shift;
+        if(!(c & 0x80)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static uint64_t _ZigZag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t _UnZigZag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+int Kit_SaveKeyframeIndex(const Kit_KeyframeIndex *index, const char *path) {
+    assert(index != NULL);
+    assert(path != NULL);
+
+    FILE *fp = fopen(path, "wb");
+    if(fp == NULL) {
+        Kit_SetError("Unable to open %s for writing", path);
+        return 1;
+    }
+
+    int err = 0;
+    err |= fwrite(KIT_KEYFRAME_MAGIC, 1, 4, fp) != 4;
+    err |= _WriteVarint(fp, index->stream_idx);
+    err |= _WriteVarint(fp, index->tb_num);
+    err |= _WriteVarint(fp, index->tb_den);
+    err |= _WriteVarint(fp, index->count);
+    int64_t last_pts = 0;
+    int64_t last_pos = 0;
+    for(int i = 0; i < index->count && !err; i++) {
+        err |= _WriteVarint(fp, _ZigZag(index->pts[i] - last_pts));
+        err |= _WriteVarint(fp, _ZigZag(index->pos[i] - last_pos));
+        last_pts = index->pts[i];
+        last_pos = index->pos[i];
+    }
+    err |= fclose(fp) != 0;
+    if(err) {
+        Kit_SetError("Unable to write keyframe index to %s", path);
+        remove(path);
+        return 1;
+    }
+    return 0;
+}
+
+Kit_KeyframeIndex* Kit_LoadKeyframeIndex(const char *path) {
+    assert(path != NULL);
+    char magic[4];
+    uint64_t v[4];
+
+    FILE *fp = fopen(path, "rb");
+    if(fp == NULL) {
+        Kit_SetError("Unable to open %s", path);
+        return NULL;
+    }
+    Kit_KeyframeIndex *index = calloc(1, sizeof(Kit_KeyframeIndex));
+    if(index == NULL) {
+        Kit_SetError("Unable to allocate keyframe index");
+        goto exit_0;
+    }
+    if(fread(magic, 1, 4, fp) != 4 || memcmp(magic, KIT_KEYFRAME_MAGIC, 4) != 0) {
+        goto exit_1;
+    }
+    for(int i = 0; i < 4; i++) {
+        if(_ReadVarint(fp, &v[i]) || v[i] > INT32_MAX) {
+            goto exit_1;
+        }
+    }
+
+    // Every entry takes at least two bytes, so a corrupt count can't ask for more than the file holds
+    long start = ftell(fp);
+    if(start < 0 || fseek(fp, 0, SEEK_END) != 0) {
+        goto exit_1;
+    }
+    long end = ftell(fp);
+    if(end < start || fseek(fp, start, SEEK_SET) != 0 || v[3] > (uint64_t)(end - start) / 2) {
+        goto exit_1;
+    }
+
+    index->stream_idx = v[0];
+    index->tb_num = v[1];
+    index->tb_den = v[2];
+    index->count = v[3];
+    index->capacity = index->count;
+    if(index->count > 0) {
+        // calloc checks the size multiplication for overflow
+        index->pts = calloc(index->count, sizeof(int64_t));
+        index->pos = calloc(index->count, sizeof(int64_t));
+        if(index->pts == NULL || index->pos == NULL) {
+            goto exit_1;
+        }
+    }
+    int64_t last_pts = 0;
+    int64_t last_pos = 0;
+    for(int i = 0; i < index->count; i++) {
+        uint64_t dpts, dpos;
+        if(_ReadVarint(fp, &dpts) || _ReadVarint(fp, &dpos)) {
+            goto exit_1;
+        }
+        last_pts += _UnZigZag(dpts);
+        last_pos += _UnZigZag(dpos);
+        index->pts[i] = last_pts;
+        index->pos[i] = last_pos;
+    }
+    fclose(fp);
+    return index;
+
+exit_1:
+    Kit_SetError("Invalid keyframe index file %s", path);
+    Kit_FreeKeyframeIndex(index);
+exit_0:
+    fclose(fp);
+    return NULL;
+}
@@ -1,6 +1,7 @@
 #include "kitchensink/kitchensink.h"
 #include "kitchensink/internal/kitlibstate.h"
 #include <libavformat/avformat.h>
+#include <libavfilter/avfilter.h>
 #include <ass/ass.h>
 #include <assert.h>
 
@@ -21,6 +22,9 @@ int Kit_Init(unsigned int flags) {
         av_register_all();
     }
 
+    // Filters are needed for audio time stretching
+    avfilter_register_all();
+
     state->init_flags = flags;
 
     // Init libass
@@ -0,0 +1,161 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "kitchensink/kitsource.h"
+#include "kitchensink/kiterror.h"
+#include "kitchensink/internal/kitsourceio.h"
+
+#include <libavformat/avformat.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Window of the file the kernel is asked to have paged in ahead of the read position
+#define KIT_MAPPED_WINDOW (4 * 1024 * 1024)
+
+typedef struct Kit_MappedReader {
+    unsigned char *data; ///< Start of the mapping
+    int64_t size; ///< File size in bytes
+    int64_t pos; ///< Current read position
+    int64_t advised_start; ///< Start of the range read contiguously since the last jump
+    int64_t advised_end; ///< End of the range already hinted with WILLNEED
+    long page_size;
+} Kit_MappedReader;
+
+// Asks the kernel to page in a window from the read position on
+static void _AdviseWindow(Kit_MappedReader *reader) {
+    int64_t start = reader->pos - (reader->pos % reader->page_size);
+    int64_t len = reader->size - start;
+    if(len > KIT_MAPPED_WINDOW) {
+        len = KIT_MAPPED_WINDOW;
+    }
+    if(len > 0) {
+        // A seek may have hinted this range as random before; reads here are in order again
+        posix_madvise(reader->data + start, len, POSIX_MADV_SEQUENTIAL);
+        posix_madvise(reader->data + start, len, POSIX_MADV_WILLNEED);
+    }
+    reader->advised_end = start + len;
+}
+
+static void _AdviseAhead(Kit_MappedReader *reader) {
+    // Request the next window when the reader is halfway through the previous one
+    if(reader->pos + KIT_MAPPED_WINDOW / 2 < reader->advised_end) {
+        return;
+    }
+    _AdviseWindow(reader);
+}
+
+static int _MappedRead(void *opaque, uint8_t *buf, int size) {
+    Kit_MappedReader *reader = opaque;
+    int64_t left = reader->size - reader->pos;
+    if(left <= 0) {
+        return AVERROR_EOF;
+    }
+    if(size > left) {
+        size = left;
+    }
+    _AdviseAhead(reader);
+    memcpy(buf, reader->data + reader->pos, size);
+    reader->pos += size;
+    return size;
+}
+
+static int64_t _MappedSeek(void *opaque, int64_t offset, int whence) {
+    Kit_MappedReader *reader = opaque;
+    int64_t pos;
+    switch(whence & ~AVSEEK_FORCE) {
+        case AVSEEK_SIZE: return reader->size;
+        case SEEK_SET: pos = offset; break;
+        case SEEK_CUR: pos = reader->pos + offset; break;
+        case SEEK_END: pos = reader->size + offset; break;
+        default:
+            return AVERROR(EINVAL);
+    }
+    if(pos < 0 || pos > reader->size) {
+        return AVERROR(EINVAL);
+    }
+
+    // Short hops back into what was just read are served from memory, and need no hints. On a jump
+    // elsewhere, keep the kernel from reading around the data behind the new position, and fetch
+    // the window ahead of it instead. The rest of the file keeps its sequential hint.
+    bool jump = (pos < reader->advised_start || pos > reader->advised_end);
+    reader->pos = pos;
+    if(jump) {
+        int64_t behind = pos - (pos % reader->page_size);
+        int64_t back = (behind > KIT_MAPPED_WINDOW) ? behind - KIT_MAPPED_WINDOW : 0;
+        if(behind > back) {
+            posix_madvise(reader->data + back, behind - back, POSIX_MADV_RANDOM);
+        }
+        reader->advised_start = behind;
+        _AdviseWindow(reader);
+    }
+    return pos;
+}
+
+static void _MappedClose(void *opaque) {
+    Kit_MappedReader *reader = opaque;
+    munmap(reader->data, reader->size);
+    free(reader);
+}
+
+Kit_Source* Kit_CreateSourceFromMappedFile(const char *path) {
+    assert(path != NULL);
+    struct stat st;
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        Kit_SetError("Unable to open file %s", path);
+        return NULL;
+    }
+    if(fstat(fd, &st) != 0 || st.st_size <= 0) {
+        Kit_SetError("Unable to map empty or unreadable file %s", path);
+        goto exit_0;
+    }
+
+    Kit_MappedReader *reader = calloc(1, sizeof(Kit_MappedReader));
+    if(reader == NULL) {
+        Kit_SetError("Unable to allocate mapped reader");
+        goto exit_0;
+    }
+
+    // Mapping stays valid after the descriptor is closed
+    reader->data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(reader->data == MAP_FAILED) {
+        Kit_SetError("Unable to map file %s: %s", path, strerror(errno));
+        free(reader);
+        goto exit_0;
+    }
+    close(fd);
+
+    reader->size = st.st_size;
+    reader->page_size = sysconf(_SC_PAGESIZE);
+    posix_madvise(reader->data, reader->size, POSIX_MADV_SEQUENTIAL);
+
+    Kit_SourceOptions opts;
+    Kit_InitSourceOptions(&opts);
+    return Kit_OpenCustomSource(path, _MappedRead, _MappedSeek, reader, _MappedClose, KIT_AVIO_BUFFERSIZE, &opts, NULL);
+
+exit_0:
+    close(fd);
+    return NULL;
+}
+
+#else
+
+Kit_Source* Kit_CreateSourceFromMappedFile(const char *path) {
+    assert(path != NULL);
+    Kit_SetError("Memory mapped sources are not supported on this platform");
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,142 @@
+#include "kitchensink/internal/kitpacketbuffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define KIT_PACKETBUFFER_INITIAL_CAPACITY 1024
+
+Kit_PacketBuffer* Kit_CreatePacketBuffer(double max_seconds, size_t max_bytes) {
+    Kit_PacketBuffer *buffer = calloc(1, sizeof(Kit_PacketBuffer));
+    if(buffer == NULL) {
+        return NULL;
+    }
+    buffer->cursor = -1;
+    buffer->max_seconds = max_seconds;
+    buffer->max_bytes = max_bytes;
+    return buffer;
+}
+
+void Kit_DestroyPacketBuffer(Kit_PacketBuffer *buffer) {
+    if(buffer == NULL) return;
+    Kit_ClearPacketBuffer(buffer);
+    free(buffer->packets);
+    free(buffer);
+}
+
+static void _DropOldestPacket(Kit_PacketBuffer *buffer) {
+    Kit_BufferedPacket *oldest = &buffer->packets[buffer->head];
+    buffer->bytes -= oldest->packet->size;
+    av_packet_free(&oldest->packet);
+    buffer->head++;
+    buffer->count--;
+    if(buffer->count == 0) {
+        buffer->head = 0;
+    }
+}
+
+void Kit_ClearPacketBuffer(Kit_PacketBuffer *buffer) {
+    assert(buffer != NULL);
+    while(buffer->count > 0) {
+        _DropOldestPacket(buffer);
+    }
+    buffer->cursor = -1;
+}
+
+static bool _IsOverLimits(const Kit_PacketBuffer *buffer) {
+    if(buffer->count < 2) {
+        return false;
+    }
+    if(buffer->max_bytes > 0 && buffer->bytes > buffer->max_bytes) {
+        return true;
+    }
+    if(buffer->max_seconds > 0) {
+        double first = buffer->packets[buffer->head].pts;
+        double last = buffer->packets[buffer->head + buffer->count - 1].pts;
+        if(last - first > buffer->max_seconds) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int Kit_WritePacketBuffer(Kit_PacketBuffer *buffer, const AVPacket *packet, double pts, bool is_anchor) {
+    assert(buffer != NULL);
+    assert(packet != NULL);
+
+    // Make room at the end; slide the window back to the start of the array before growing it
+    if(buffer->head + buffer->count == buffer->capacity) {
+        if(buffer->head > 0) {
+            memmove(buffer->packets, buffer->packets + buffer->head, buffer->count * sizeof(Kit_BufferedPacket));
+            if(buffer->cursor >= 0) {
+                buffer->cursor -= buffer->head;
+            }
+            buffer->head = 0;
+        }
+        if(buffer->count == buffer->capacity) {
+            int capacity = buffer->capacity > 0 ? buffer->capacity * 2 : KIT_PACKETBUFFER_INITIAL_CAPACITY;
+            Kit_BufferedPacket *packets = realloc(buffer->packets, capacity * sizeof(Kit_BufferedPacket));
+            if(packets == NULL) {
+                return 1;
+            }
+            buffer->packets = packets;
+            buffer->capacity = capacity;
+        }
+    }
+
+    AVPacket *ref = av_packet_clone(packet);
+    if(ref == NULL) {
+        return 1;
+    }
+    Kit_BufferedPacket *slot = &buffer->packets[buffer->head + buffer->count];
+    slot->packet = ref;
+    slot->pts = pts;
+    slot->is_anchor = is_anchor;
+    buffer->count++;
+    buffer->bytes += ref->size;
+
+    // Packets still waiting to be replayed are never dropped
+    while(_IsOverLimits(buffer) && buffer->cursor != buffer->head) {
+        _DropOldestPacket(buffer);
+    }
+    return 0;
+}
+
+int Kit_SeekPacketBuffer(Kit_PacketBuffer *buffer, double time) {
+    assert(buffer != NULL);
+    if(buffer->count == 0) {
+        return 1;
+    }
+
+    // Target must be inside the window, and there must be a point to start playback from before it
+    int last = buffer->head + buffer->count - 1;
+    if(time > buffer->packets[last].pts) {
+        return 1;
+    }
+    for(int i = last; i >= buffer->head; i--) {
+        if(buffer->packets[i].is_anchor && buffer->packets[i].pts <= time) {
+            buffer->cursor = i;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int Kit_ReadPacketBuffer(Kit_PacketBuffer *buffer, AVPacket *packet) {
+    assert(buffer != NULL);
+    assert(packet != NULL);
+    if(buffer->cursor < 0) {
+        return 1;
+    }
+    if(av_packet_ref(packet, buffer->packets[buffer->cursor].packet) < 0) {
+        buffer->cursor = -1;
+        return 1;
+    }
+
+    // Back at the live edge; the demuxer continues right where the window ends
+    buffer->cursor++;
+    if(buffer->cursor == buffer->head + buffer->count) {
+        buffer->cursor = -1;
+    }
+    return 0;
+}
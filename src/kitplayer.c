@@ -3,6 +3,7 @@
 #include "kitchensink/internal/kitbuffer.h"
 #include "kitchensink/internal/kitringbuffer.h"
 #include "kitchensink/internal/kitlist.h"
+#include "kitchensink/internal/kitpacketbuffer.h"
 #include "kitchensink/internal/kitlibstate.h"
 
 #include <libavcodec/avcodec.h>
@@ -14,11 +15,15 @@
 #include <libavutil/samplefmt.h>
 #include <libavutil/avstring.h>
 #include <libavutil/imgutils.h>
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersrc.h>
+#include <libavfilter/buffersink.h>
 
 #include <SDL2/SDL.h>
 #include <ass/ass.h>
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <assert.h>
 #include <math.h>
@@ -32,7 +37,28 @@
 
 // Threshold is in seconds
 #define VIDEO_SYNC_THRESHOLD 0.01
-#define AUDIO_SYNC_THRESHOLD 0.05
+#define AUDIO_SYNC_THRESHOLD 0.2
+#define AUDIO_DRIFT_THRESHOLD 0.005
+
+// Audio drift correction. Drift is averaged over time, and at most AUDIO_DRIFT_MAX_CORRECTION
+// of each decoded frame may be stretched or squeezed away by the resampler.
+#define AUDIO_DRIFT_AVG_COEF 0.9
+#define AUDIO_DRIFT_MAX_CORRECTION 0.1
+
+// Playback rate limits. Above KIT_RATE_SKIP_NONREF, non-reference video frames are not decoded.
+#define KIT_RATE_MIN 0.25
+#define KIT_RATE_MAX 4.0
+#define KIT_RATE_SKIP_NONREF 1.5
+
+// Decoded data kept for an A-B loop at most, unless changed. Longer loops are re-demuxed on every pass.
+#define KIT_LOOP_DEFAULT_MEGABYTES 256
+
+// Packets demuxed from a queued source before it takes over, at most. Reading stops earlier
+// once its first GOP is in.
+#define KIT_PREREAD_PACKETS 64
+
+// Demuxers where a keyframe's byte offset is a valid resync point for byte seeking
+#define KIT_BYTESEEK_FORMATS "mpegts,mpeg,mpegvideo,h264,hevc"
 
 // Buffersizes
 #define KIT_VBUFFERSIZE 3
@@ -40,6 +66,10 @@
 #define KIT_CBUFFERSIZE 8
 #define KIT_SBUFFERSIZE 512
 
+// Buffersizes for live sources. Keep these tiny; every queued packet adds latency.
+#define KIT_VBUFFERSIZE_LIVE 2
+#define KIT_ABUFFERSIZE_LIVE 4
+
 typedef enum Kit_ControlPacketType {
     KIT_CONTROL_SEEK,
     KIT_CONTROL_FLUSH
@@ -52,6 +82,8 @@ typedef struct Kit_VideoPacket {
 
 typedef struct Kit_AudioPacket {
     double pts;
+    double drift_comp;
+    double rate; ///< Playback rate the samples were time stretched at
     size_t original_size;
     Kit_RingBuffer *rb;
 } Kit_AudioPacket;
@@ -61,6 +93,34 @@ typedef struct Kit_ControlPacket {
     double value1;
 } Kit_ControlPacket;
 
+typedef struct Kit_LoopVideoFrame {
+    AVFrame *frame; ///< Decoded frame in the decoder's native format
+    double pts;
+} Kit_LoopVideoFrame;
+
+typedef struct Kit_LoopAudioChunk {
+    unsigned char *data; ///< Resampled samples in the output format
+    size_t len;
+    int nb_samples;
+    double pts;
+} Kit_LoopAudioChunk;
+
+typedef struct Kit_LoopCache {
+    Kit_LoopVideoFrame *vframes;
+    int vcount, vcapacity;
+    Kit_LoopAudioChunk *achunks;
+    int acount, acapacity;
+    size_t bytes; ///< Memory held by the frames and chunks
+    size_t max_bytes; ///< Limit for bytes; the segment is not recorded if it doesn't fit
+    bool capturing; ///< Current pass started at the loop start, and is being recorded
+    bool complete; ///< Whole segment is recorded; passes are replayed from memory
+    bool too_large; ///< Segment doesn't fit in memory; every pass is demuxed again
+    bool vdone; ///< Video of the current pass has reached the loop end
+    bool adone; ///< Audio of the current pass has reached the loop end
+    int vpos; ///< Next video frame to replay
+    int apos; ///< Next audio chunk to replay
+} Kit_LoopCache;
+
 typedef struct Kit_SubtitlePacket {
     double pts_start;
     double pts_end;
@@ -69,8 +129,8 @@ typedef struct Kit_SubtitlePacket {
     SDL_Texture *texture;
 } Kit_SubtitlePacket;
 
-static int _InitCodecs(Kit_Player *player, const Kit_Source *src) {
-    assert(player != NULL);
+// Opens decoders for the selected streams of the source. Stream types with a NULL output are skipped.
+static int _InitCodecs(const Kit_Source *src, void **acodec_out, void **vcodec_out, void **scodec_out) {
     assert(src != NULL);
 
     AVCodecContext *acodec_ctx = NULL;
@@ -85,7 +145,7 @@ static int _InitCodecs(Kit_Player *player, const Kit_Source *src) {
     if(src->astream_idx >= (int)format_ctx->nb_streams) {
         Kit_SetError("Invalid audio stream index: %d", src->astream_idx);
         goto exit_0;
-    } else if(src->astream_idx >= 0) {
+    } else if(src->astream_idx >= 0 && acodec_out != NULL) {
         // Find audio decoder
         acodec = avcodec_find_decoder(format_ctx->streams[src->astream_idx]->codec->codec_id);
         if(!acodec) {
@@ -111,7 +171,7 @@ static int _InitCodecs(Kit_Player *player, const Kit_Source *src) {
     if(src->vstream_idx >= (int)format_ctx->nb_streams) {
         Kit_SetError("Invalid video stream index: %d", src->vstream_idx);
         goto exit_2;
-    } else if(src->vstream_idx >= 0) {
+    } else if(src->vstream_idx >= 0 && vcodec_out != NULL) {
         // Find video decoder
         vcodec = avcodec_find_decoder(format_ctx->streams[src->vstream_idx]->codec->codec_id);
         if(!vcodec) {
@@ -126,6 +186,14 @@ static int _InitCodecs(Kit_Player *player, const Kit_Source *src) {
             goto exit_2;
         }
 
+        // For live sources, output each frame as soon as possible. Frame threading would
+        // delay output by a frame per thread, so only use slice threading.
+        if(src->is_live) {
+            vcodec_ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+            vcodec_ctx->flags2 |= AV_CODEC_FLAG2_FAST;
+            vcodec_ctx->thread_type = FF_THREAD_SLICE;
+        }
+
         // Create a video decoder context
         if(avcodec_open2(vcodec_ctx, vcodec, NULL) < 0) {
             Kit_SetError("Unable to allocate video codec context");
@@ -136,7 +204,7 @@ static int _InitCodecs(Kit_Player *player, const Kit_Source *src) {
     if(src->sstream_idx >= (int)format_ctx->nb_streams) {
         Kit_SetError("Invalid subtitle stream index: %d", src->sstream_idx);
         goto exit_2;
-    } else if(src->sstream_idx >= 0) {
+    } else if(src->sstream_idx >= 0 && scodec_out != NULL) {
         // Find subtitle decoder
         scodec = avcodec_find_decoder(format_ctx->streams[src->sstream_idx]->codec->codec_id);
         if(!scodec) {
@@ -158,10 +226,12 @@ static int _InitCodecs(Kit_Player *player, const Kit_Source *src) {
         }
     }
 
-    player->acodec_ctx = acodec_ctx;
-    player->vcodec_ctx = vcodec_ctx;
-    player->scodec_ctx = scodec_ctx;
-    player->src = src;
+    if(acodec_out != NULL)
+        *acodec_out = acodec_ctx;
+    if(vcodec_out != NULL)
+        *vcodec_out = vcodec_ctx;
+    if(scodec_out != NULL)
+        *scodec_out = scodec_ctx;
     return 0;
 
 exit_5:
@@ -270,6 +340,84 @@ static unsigned int _FindAVChannelLayout(int channels) {
     }
 }
 
+// Converts decoded audio to the output format of the player
+static struct SwrContext* _CreateResampler(const Kit_Player *player, const AVCodecContext *acodec_ctx) {
+    struct SwrContext *swr = swr_alloc_set_opts(
+        NULL,
+        _FindAVChannelLayout(player->aformat.channels), // Target channel layout
+        _FindAVSampleFormat(player->aformat.format), // Target fmt
+        player->aformat.samplerate, // Target samplerate
+        acodec_ctx->channel_layout, // Source channel layout
+        acodec_ctx->sample_fmt, // Source fmt
+        acodec_ctx->sample_rate, // Source samplerate
+        0, NULL);
+    if(swr == NULL || swr_init(swr) != 0) {
+        Kit_SetError("Unable to initialize audio converter context");
+        swr_free(&swr);
+        return NULL;
+    }
+    return swr;
+}
+
+// Converts decoded video to the output format and size of the player
+static struct SwsContext* _CreateScaler(const Kit_Player *player, const AVCodecContext *vcodec_ctx) {
+    struct SwsContext *sws = sws_getContext(
+        vcodec_ctx->width, // Source w
+        vcodec_ctx->height, // Source h
+        vcodec_ctx->pix_fmt, // Source fmt
+        player->vformat.width, // Target w
+        player->vformat.height, // Target h
+        _FindAVPixelFormat(player->vformat.format), // Target fmt
+        SWS_BICUBIC,
+        NULL, NULL, NULL);
+    if(sws == NULL) {
+        Kit_SetError("Unable to initialize video converter context");
+    }
+    return sws;
+}
+
+// Start of a queued source, demuxed while the current one is still playing
+typedef struct Kit_Preread {
+    AVPacket *packets[KIT_PREREAD_PACKETS];
+    int count;
+    int pos; ///< Next packet to hand to the decoders once the source has taken over
+    bool keyframe; ///< Video keyframe starting the first GOP has been read
+    bool done; ///< First GOP is in, or the packet limit or end of the source was reached
+} Kit_Preread;
+
+static void _FreePreread(Kit_Preread *preread) {
+    if(preread == NULL) return;
+    for(int i = preread->pos; i < preread->count; i++) {
+        av_packet_free(&preread->packets[i]);
+    }
+    free(preread);
+}
+
+// Decoders and converters of a source queued to play next. Everything is set up as soon as
+// the source is queued, so that the decoder thread can carry on with it without a pause.
+typedef struct Kit_QueuedItem {
+    const Kit_Source *src;
+    AVCodecContext *acodec_ctx;
+    AVCodecContext *vcodec_ctx;
+    struct SwrContext *swr;
+    struct SwsContext *sws;
+    Kit_Preread *preread;
+} Kit_QueuedItem;
+
+static void _FreeQueuedItem(Kit_QueuedItem *item) {
+    if(item == NULL) return;
+    _FreePreread(item->preread);
+    if(item->sws != NULL) {
+        sws_freeContext(item->sws);
+    }
+    swr_free(&item->swr);
+    avcodec_close(item->acodec_ctx);
+    avcodec_close(item->vcodec_ctx);
+    avcodec_free_context(&item->acodec_ctx);
+    avcodec_free_context(&item->vcodec_ctx);
+    free(item);
+}
+
 static Kit_VideoPacket* _CreateVideoPacket(AVFrame *frame, double pts) {
     Kit_VideoPacket *p = calloc(1, sizeof(Kit_VideoPacket));
     p->frame = frame;
@@ -335,6 +483,298 @@ static double _GetSystemTime() {
     return (double)av_gettime() / 1000000.0;
 }
 
+// Falls back to the external clock if the selected master has no usable data yet
+static Kit_SyncMaster _GetSyncMaster(const Kit_Player *player) {
+    if(player->sync_master == KIT_SYNC_AUDIO && player->acodec_ctx != NULL && player->aclock_time > 0) {
+        return KIT_SYNC_AUDIO;
+    }
+    if(player->sync_master == KIT_SYNC_VIDEO && player->vcodec_ctx != NULL && player->vclock_time > 0) {
+        return KIT_SYNC_VIDEO;
+    }
+    return KIT_SYNC_EXTERNAL;
+}
+
+// All clocks advance at the playback rate
+static double _GetExternalClock(const Kit_Player *player) {
+    return (_GetSystemTime() - player->clock_sync) * player->rate;
+}
+
+static double _GetMasterClock(const Kit_Player *player) {
+    switch(_GetSyncMaster(player)) {
+        case KIT_SYNC_AUDIO:
+            return player->aclock_pos + (_GetSystemTime() - player->aclock_time) * player->rate;
+        case KIT_SYNC_VIDEO:
+            return player->vclock_pos + (_GetSystemTime() - player->vclock_time) * player->rate;
+        default:
+            return _GetExternalClock(player);
+    }
+}
+
+static void _SetExternalClock(Kit_Player *player, double pts) {
+    player->clock_sync = _GetSystemTime() - pts / player->rate;
+}
+
+// First frame after a seek is out; start the clocks from it
+static void _FinishSeek(Kit_Player *player, double pts) {
+    player->vclock_pos = pts;
+    if(player->state == KIT_PAUSED) {
+        // Resuming shifts the clock by the whole pause, so start from the pause beginning
+        player->clock_sync = player->pause_start - pts / player->rate;
+    } else {
+        _SetExternalClock(player, pts);
+    }
+    player->seek_flag = 0;
+    if(player->seek_start > 0) {
+        player->seek_time = _GetSystemTime() - player->seek_start;
+        player->seek_start = 0;
+    }
+}
+
+// Jump directly to the byte offset of the keyframe preceding pos, if the source has an index
+static int _SeekWithIndex(Kit_Player *player, double pos) {
+    AVFormatContext *fmt_ctx = (AVFormatContext *)player->src->format_ctx;
+    const Kit_KeyframeIndex *index = player->src->keyframe_index;
+    if(index == NULL) {
+        return 1;
+    }
+    int i = Kit_FindKeyframe(index, pos);
+    if(i < 0) {
+        return 1;
+    }
+
+    // Only demuxers that resync on packet start codes can continue from an arbitrary byte offset.
+    // Everything else (mp4, matroska, ...) is asked for the keyframe timestamp instead.
+    if(!(fmt_ctx->iformat->flags & AVFMT_NO_BYTE_SEEK)
+            && av_match_name(fmt_ctx->iformat->name, KIT_BYTESEEK_FORMATS)) {
+        return av_seek_frame(fmt_ctx, -1, index->pos[i], AVSEEK_FLAG_BYTE) < 0;
+    }
+    int64_t ts = index->pts[i];
+    return avformat_seek_file(fmt_ctx, index->stream_idx, INT64_MIN, ts, ts, 0) < 0;
+}
+
+static void _ClearLoopCache(Kit_LoopCache *cache) {
+    for(int i = 0; i < cache->vcount; i++) {
+        av_frame_free(&cache->vframes[i].frame);
+    }
+    for(int i = 0; i < cache->acount; i++) {
+        free(cache->achunks[i].data);
+    }
+    free(cache->vframes);
+    free(cache->achunks);
+    cache->vframes = NULL;
+    cache->achunks = NULL;
+    cache->vcount = cache->vcapacity = 0;
+    cache->acount = cache->acapacity = 0;
+    cache->bytes = 0;
+    cache->complete = false;
+    cache->vpos = cache->apos = 0;
+}
+
+static void _FreeLoopCache(Kit_LoopCache *cache) {
+    if(cache == NULL) return;
+    _ClearLoopCache(cache);
+    free(cache);
+}
+
+// Stops recording the current pass, eg. because it doesn't fit in memory
+static void _AbortLoopCapture(Kit_LoopCache *cache) {
+    _ClearLoopCache(cache);
+    cache->capturing = false;
+    cache->too_large = true;
+}
+
+// The frame still showing at the loop start is recorded too, so that replayed passes begin with it
+static void _CaptureLoopVideo(Kit_Player *player, const AVFrame *frame, double pts, double duration) {
+    Kit_LoopCache *cache = (Kit_LoopCache*)player->loop_cache;
+    if(!cache->capturing || (pts < player->loop_start && pts + duration <= player->loop_start)) {
+        return;
+    }
+    size_t size = av_image_get_buffer_size(frame->format, frame->width, frame->height, 1);
+    if(cache->bytes + size > cache->max_bytes) {
+        _AbortLoopCapture(cache);
+        return;
+    }
+    if(cache->vcount == cache->vcapacity) {
+        int capacity = cache->vcapacity > 0 ? cache->vcapacity * 2 : 64;
+        Kit_LoopVideoFrame *vframes = realloc(cache->vframes, capacity * sizeof(Kit_LoopVideoFrame));
+        if(vframes == NULL) {
+            _AbortLoopCapture(cache);
+            return;
+        }
+        cache->vframes = vframes;
+        cache->vcapacity = capacity;
+    }
+
+    // Keeps a reference if the decoder hands out refcounted frames, copies otherwise
+    AVFrame *copy = av_frame_clone(frame);
+    if(copy == NULL) {
+        _AbortLoopCapture(cache);
+        return;
+    }
+    cache->vframes[cache->vcount].frame = copy;
+    cache->vframes[cache->vcount].pts = pts;
+    cache->vcount++;
+    cache->bytes += size;
+}
+
+static void _CaptureLoopAudio(Kit_Player *player, const unsigned char *data, size_t len, int nb_samples, double pts) {
+    Kit_LoopCache *cache = (Kit_LoopCache*)player->loop_cache;
+    if(!cache->capturing || len == 0) {
+        return;
+    }
+    if(cache->bytes + len > cache->max_bytes) {
+        _AbortLoopCapture(cache);
+        return;
+    }
+    if(cache->acount == cache->acapacity) {
+        int capacity = cache->acapacity > 0 ? cache->acapacity * 2 : 256;
+        Kit_LoopAudioChunk *achunks = realloc(cache->achunks, capacity * sizeof(Kit_LoopAudioChunk));
+        if(achunks == NULL) {
+            _AbortLoopCapture(cache);
+            return;
+        }
+        cache->achunks = achunks;
+        cache->acapacity = capacity;
+    }
+    unsigned char *copy = malloc(len);
+    if(copy == NULL) {
+        _AbortLoopCapture(cache);
+        return;
+    }
+    memcpy(copy, data, len);
+    cache->achunks[cache->acount].data = copy;
+    cache->achunks[cache->acount].len = len;
+    cache->achunks[cache->acount].nb_samples = nb_samples;
+    cache->achunks[cache->acount].pts = pts;
+    cache->acount++;
+    cache->bytes += len;
+}
+
+// Drops packets read ahead of the switch to the current source, before the demuxer is moved.
+// Those continue from where the packet window ends, so the window would have a hole in it too.
+static void _DropPreread(Kit_Player *player) {
+    if(player->preread == NULL) {
+        return;
+    }
+    _FreePreread((Kit_Preread*)player->preread);
+    player->preread = NULL;
+    if(player->dvr != NULL) {
+        Kit_ClearPacketBuffer((Kit_PacketBuffer*)player->dvr);
+    }
+}
+
+// Moves the demuxer back to the loop start, without disturbing anything already queued
+static void _RestartLoopPass(Kit_Player *player) {
+    AVFormatContext *fmt_ctx = (AVFormatContext *)player->src->format_ctx;
+    Kit_LoopCache *cache = (Kit_LoopCache*)player->loop_cache;
+    int64_t seek_target = player->loop_start * AV_TIME_BASE;
+
+    _DropPreread(player);
+    if(player->dvr == NULL || Kit_SeekPacketBuffer((Kit_PacketBuffer*)player->dvr, player->loop_start) != 0) {
+        if(player->dvr != NULL) {
+            Kit_ClearPacketBuffer((Kit_PacketBuffer*)player->dvr);
+        }
+        if(_SeekWithIndex(player, player->loop_start) != 0) {
+            avformat_seek_file(fmt_ctx, -1, INT64_MIN, seek_target, seek_target, 0);
+        }
+    }
+    if(player->vcodec_ctx != NULL)
+        avcodec_flush_buffers(player->vcodec_ctx);
+    if(player->acodec_ctx != NULL)
+        avcodec_flush_buffers(player->acodec_ctx);
+
+    // Loop point must be seamless, so always decode up to the exact start
+    player->vseek_target = player->loop_start;
+    player->aseek_target = player->loop_start;
+    cache->vdone = false;
+    cache->adone = false;
+}
+
+// Called when a stream reaches the loop end. Once all of them have, the next pass begins:
+// from memory if the whole segment was recorded, or by demuxing it again if not.
+// Returns 1 if the segment turned out to have nothing in it, and looping was given up.
+static int _EndLoopPass(Kit_Player *player, bool is_video) {
+    Kit_LoopCache *cache = (Kit_LoopCache*)player->loop_cache;
+    if(is_video) {
+        cache->vdone = true;
+    } else {
+        cache->adone = true;
+    }
+    if((player->vcodec_ctx != NULL && !cache->vdone) || (player->acodec_ctx != NULL && !cache->adone)) {
+        return 0;
+    }
+
+    if(cache->capturing) {
+        cache->capturing = false;
+        if(cache->vcount == 0 && cache->acount == 0) {
+            player->loop_end = 0;
+            return 1;
+        }
+        cache->complete = true;
+        cache->vpos = 0;
+        cache->apos = 0;
+    } else {
+        // Record the next pass, unless the segment is already known not to fit
+        cache->capturing = !cache->too_large;
+        _RestartLoopPass(player);
+    }
+    player->loop_offset += player->loop_end - player->loop_start;
+    return 0;
+}
+
+// Converts the frame to the output format, and queues it for the application
+static void _QueueVideoFrame(Kit_Player *player, const AVFrame *iframe, double pts) {
+    // Target frame
+    AVFrame *oframe = av_frame_alloc();
+    av_image_alloc(
+        oframe->data,
+        oframe->linesize,
+        player->vformat.width,
+        player->vformat.height,
+        _FindAVPixelFormat(player->vformat.format),
+        1);
+
+    // Convert to the target format. Size only changes for queued sources of a different size.
+    sws_scale(
+        (struct SwsContext *)player->sws,
+        (const unsigned char * const *)iframe->data,
+        iframe->linesize,
+        0,
+        iframe->height,
+        oframe->data,
+        oframe->linesize);
+
+    // Just seeked, set sync clock & pos.
+    if(player->seek_flag == 1) {
+        _FinishSeek(player, pts);
+    }
+
+    // Lock, write to audio buffer, unlock
+    Kit_VideoPacket *vpacket = _CreateVideoPacket(oframe, pts);
+    bool done = false;
+    if(SDL_LockMutex(player->vmutex) == 0) {
+        // Live sources don't wait for the application. If the oldest frame is still
+        // waiting for its turn, latency has built up; drop it and move the clock
+        // forwards to catch up.
+        if(player->src->is_live && Kit_IsBufferFull((Kit_Buffer*)player->vbuffer)) {
+            Kit_VideoPacket *old = Kit_ReadBuffer((Kit_Buffer*)player->vbuffer);
+            if(_GetExternalClock(player) < old->pts) {
+                _SetExternalClock(player, old->pts);
+            }
+            _FreeVideoPacket(old);
+        }
+        if(Kit_WriteBuffer((Kit_Buffer*)player->vbuffer, vpacket) == 0) {
+            done = true;
+        }
+        SDL_UnlockMutex(player->vmutex);
+    }
+
+    // Unable to write packet, free it.
+    if(!done) {
+        _FreeVideoPacket(vpacket);
+    }
+}
+
 static void _HandleVideoPacket(Kit_Player *player, AVPacket *packet) {
     assert(player != NULL);
     assert(packet != NULL);
@@ -351,26 +791,6 @@ static void _HandleVideoPacket(Kit_Player *player, AVPacket *packet) {
         }
 
         if(frame_finished) {
-            // Target frame
-            AVFrame *oframe = av_frame_alloc();
-            av_image_alloc(
-                oframe->data,
-                oframe->linesize,
-                vcodec_ctx->width,
-                vcodec_ctx->height,
-                _FindAVPixelFormat(player->vformat.format),
-                1);
-
-            // Scale from source format to target format, don't touch the size
-            sws_scale(
-                (struct SwsContext *)player->sws,
-                (const unsigned char * const *)iframe->data,
-                iframe->linesize,
-                0,
-                vcodec_ctx->height,
-                oframe->data,
-                oframe->linesize);
-
             // Get pts
             double pts = 0;
             if(packet->dts != AV_NOPTS_VALUE) {
@@ -378,33 +798,244 @@ static void _HandleVideoPacket(Kit_Player *player, AVPacket *packet) {
                 pts *= av_q2d(fmt_ctx->streams[player->src->vstream_idx]->time_base);
             }
 
-            // Just seeked, set sync clock & pos.
-            if(player->seek_flag == 1) {
-                player->vclock_pos = pts;
-                player->clock_sync = _GetSystemTime() - pts;
-                player->seek_flag = 0;
+            // Prefer the frame's own duration; the average rate is unknown (0) for many VFR streams
+            AVStream *vstream = fmt_ctx->streams[player->src->vstream_idx];
+            int64_t pkt_duration = av_frame_get_pkt_duration(player->tmp_vframe);
+            double frame_duration = 0;
+            if(pkt_duration > 0) {
+                frame_duration = pkt_duration * av_q2d(vstream->time_base);
+            } else if(vstream->avg_frame_rate.num > 0 && vstream->avg_frame_rate.den > 0) {
+                frame_duration = 1.0 / av_q2d(vstream->avg_frame_rate);
             }
-
-            // Lock, write to audio buffer, unlock
-            Kit_VideoPacket *vpacket = _CreateVideoPacket(oframe, pts);
-            bool done = false;
-            if(SDL_LockMutex(player->vmutex) == 0) {
-                if(Kit_WriteBuffer((Kit_Buffer*)player->vbuffer, vpacket) == 0) {
-                    done = true;
+            player->item_end = FFMAX(player->item_end, pts + frame_duration);
+
+            // Exact seek: frames that end before the target are only decoded as references for
+            // the following ones, so drop them before spending any time converting them. Without
+            // a known duration, only frames that start before the target can be told apart.
+            if(player->vseek_target >= 0) {
+                bool before = (frame_duration > 0)
+                    ? pts + frame_duration <= player->vseek_target
+                    : pts < player->vseek_target;
+                if(before) {
+                    packet->size -= len;
+                    packet->data += len;
+                    continue;
                 }
-                SDL_UnlockMutex(player->vmutex);
+                player->vseek_target = -1;
             }
 
-            // Unable to write packet, free it.
-            if(!done) {
-                _FreeVideoPacket(vpacket);
+            // Frames inside an A-B loop are recorded, so that later passes need no decoding
+            if(player->loop_end > 0) {
+                if(pts >= player->loop_end) {
+                    _EndLoopPass(player, true);
+                    packet->size -= len;
+                    packet->data += len;
+                    continue;
+                }
+                _CaptureLoopVideo(player, iframe, pts, frame_duration);
+                pts += player->loop_offset;
+            }
+            pts += player->item_offset;
+
+            // When playing fast, don't bother converting frames that are already too late to show.
+            if(player->dec_rate > 1.0 && player->seek_flag == 0 && player->state == KIT_PLAYING
+                && pts < _GetMasterClock(player) - VIDEO_SYNC_THRESHOLD)
+            {
+                packet->size -= len;
+                packet->data += len;
+                continue;
             }
+
+            _QueueVideoFrame(player, iframe, pts);
         }
         packet->size -= len;
         packet->data += len;
     }
 }
 
+static void _WriteAudioPacket(Kit_Player *player, const char *data, size_t len, double pts, double drift_comp) {
+    // Lock, write to audio buffer, unlock
+    Kit_AudioPacket *apacket = _CreateAudioPacket(data, len, pts);
+    apacket->drift_comp = drift_comp;
+    apacket->rate = (player->afilter_graph != NULL) ? player->dec_rate : 1.0;
+    bool done = false;
+    if(SDL_LockMutex(player->amutex) == 0) {
+        // Live sources don't wait for the application; drop the oldest audio instead.
+        if(player->src->is_live && Kit_IsBufferFull((Kit_Buffer*)player->abuffer)) {
+            Kit_AudioPacket *old = Kit_ReadBuffer((Kit_Buffer*)player->abuffer);
+            player->adrift_comp -= old->drift_comp;
+            _FreeAudioPacket(old);
+        }
+        if(Kit_WriteBuffer((Kit_Buffer*)player->abuffer, apacket) == 0) {
+            player->adrift_comp += drift_comp;
+            done = true;
+        }
+        SDL_UnlockMutex(player->amutex);
+    }
+
+    // Couldn't write packet, free memory
+    if(!done) {
+        _FreeAudioPacket(apacket);
+    }
+}
+
+static void _CloseAudioFilter(Kit_Player *player) {
+    avfilter_graph_free((AVFilterGraph**)&player->afilter_graph);
+    player->afilter_src = NULL;
+    player->afilter_sink = NULL;
+}
+
+// Builds abuffer -> atempo [-> atempo ...] -> aformat -> abuffersink for the output audio format.
+// A single atempo only handles rates between 0.5 and 2.0, so chain them as needed.
+static int _InitAudioFilter(Kit_Player *player, double rate) {
+    AVFilterGraph *graph = NULL;
+    AVFilterContext *src_ctx = NULL;
+    AVFilterContext *sink_ctx = NULL;
+    AVFilterContext *prev_ctx = NULL;
+    AVFilterContext *ctx = NULL;
+    char args[256];
+    char name[32];
+    int64_t layout = _FindAVChannelLayout(player->aformat.channels);
+    const char *fmt_name = av_get_sample_fmt_name(_FindAVSampleFormat(player->aformat.format));
+
+    graph = avfilter_graph_alloc();
+    if(graph == NULL) {
+        goto exit_0;
+    }
+
+    snprintf(args, sizeof(args),
+        "time_base=1/%d:sample_rate=%d:sample_fmt=%s:channel_layout=0x%"PRIx64,
+        player->aformat.samplerate, player->aformat.samplerate, fmt_name, layout);
+    if(avfilter_graph_create_filter(&src_ctx, avfilter_get_by_name("abuffer"), "in", args, NULL, graph) < 0) {
+        goto exit_1;
+    }
+
+    prev_ctx = src_ctx;
+    for(int n = 0; rate != 1.0; n++) {
+        double tempo = rate;
+        if(tempo > 2.0) {
+            tempo = 2.0;
+        } else if(tempo < 0.5) {
+            tempo = 0.5;
+        }
+        rate /= tempo;
+
+        snprintf(args, sizeof(args), "tempo=%f", tempo);
+        snprintf(name, sizeof(name), "atempo%d", n);
+        if(avfilter_graph_create_filter(&ctx, avfilter_get_by_name("atempo"), name, args, NULL, graph) < 0) {
+            goto exit_1;
+        }
+        if(avfilter_link(prev_ctx, 0, ctx, 0) < 0) {
+            goto exit_1;
+        }
+        prev_ctx = ctx;
+    }
+
+    snprintf(args, sizeof(args),
+        "sample_fmts=%s:sample_rates=%d:channel_layouts=0x%"PRIx64,
+        fmt_name, player->aformat.samplerate, layout);
+    if(avfilter_graph_create_filter(&ctx, avfilter_get_by_name("aformat"), "format", args, NULL, graph) < 0) {
+        goto exit_1;
+    }
+    if(avfilter_link(prev_ctx, 0, ctx, 0) < 0) {
+        goto exit_1;
+    }
+    if(avfilter_graph_create_filter(&sink_ctx, avfilter_get_by_name("abuffersink"), "out", NULL, NULL, graph) < 0) {
+        goto exit_1;
+    }
+    if(avfilter_link(ctx, 0, sink_ctx, 0) < 0) {
+        goto exit_1;
+    }
+    if(avfilter_graph_config(graph, NULL) < 0) {
+        goto exit_1;
+    }
+
+    player->afilter_graph = graph;
+    player->afilter_src = src_ctx;
+    player->afilter_sink = sink_ctx;
+    player->afilter_pts = -1;
+    player->afilter_samples = 0;
+    return 0;
+
+exit_1:
+    avfilter_graph_free(&graph);
+exit_0:
+    return 1;
+}
+
+static void _FilterAudioData(Kit_Player *player, unsigned char *data, int nb_samples, double pts, double drift_comp) {
+    int bytes_per_sample = player->aformat.bytes * player->aformat.channels;
+    AVFrame *frame = av_frame_alloc();
+    if(frame == NULL) {
+        return;
+    }
+
+    // Output timestamps are counted from the first sample that went in.
+    if(player->afilter_pts < 0) {
+        player->afilter_pts = pts;
+        player->afilter_samples = 0;
+    }
+
+    // Feed the converted samples in. The data is not refcounted, so the filter takes a copy.
+    frame->data[0] = data;
+    frame->extended_data = frame->data;
+    frame->linesize[0] = nb_samples * bytes_per_sample;
+    frame->nb_samples = nb_samples;
+    frame->format = _FindAVSampleFormat(player->aformat.format);
+    frame->sample_rate = player->aformat.samplerate;
+    frame->channel_layout = _FindAVChannelLayout(player->aformat.channels);
+    frame->channels = player->aformat.channels;
+    if(av_buffersrc_add_frame_flags((AVFilterContext*)player->afilter_src, frame, 0) < 0) {
+        av_frame_free(&frame);
+        return;
+    }
+
+    // Pull out whatever the time stretcher has ready
+    while(av_buffersink_get_frame((AVFilterContext*)player->afilter_sink, frame) >= 0) {
+        double out_pts = player->afilter_pts
+            + (double)player->afilter_samples * player->dec_rate / player->aformat.samplerate;
+        _WriteAudioPacket(
+            player,
+            (char*)frame->data[0],
+            (size_t)(frame->nb_samples * bytes_per_sample),
+            out_pts,
+            drift_comp);
+        player->afilter_samples += frame->nb_samples;
+        drift_comp = 0;
+        av_frame_unref(frame);
+    }
+
+    av_frame_free(&frame);
+}
+
+// Sets up decoders and audio filtering for the currently requested playback rate.
+static void _ApplyPlaybackRate(Kit_Player *player) {
+    double rate = player->dec_rate;
+    if(SDL_LockMutex(player->amutex) == 0) {
+        rate = player->rate;
+        SDL_UnlockMutex(player->amutex);
+    }
+    if(rate == player->dec_rate) {
+        return;
+    }
+
+    // While scrubbing, only keyframes are decoded; this is picked up again once scrubbing ends
+    if(player->vcodec_ctx != NULL && !player->dec_scrubbing) {
+        AVCodecContext *vcodec_ctx = (AVCodecContext*)player->vcodec_ctx;
+        vcodec_ctx->skip_frame = (rate > KIT_RATE_SKIP_NONREF) ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    }
+
+    if(player->acodec_ctx != NULL) {
+        _CloseAudioFilter(player);
+        if(rate != 1.0 && _InitAudioFilter(player, rate) != 0) {
+            // Can't time stretch; audio will just drift and be corrected by sync.
+            _CloseAudioFilter(player);
+        }
+    }
+
+    player->dec_rate = rate;
+}
+
 static void _HandleAudioPacket(Kit_Player *player, AVPacket *packet) {
     assert(player != NULL);
     assert(packet != NULL);
@@ -413,6 +1044,8 @@ static void _HandleAudioPacket(Kit_Player *player, AVPacket *packet) {
     int len, len2;
     int dst_linesize;
     int dst_nb_samples, dst_bufsize;
+    int max_comp;
+    double drift_comp;
     unsigned char **dst_data;
     AVCodecContext *acodec_ctx = (AVCodecContext*)player->acodec_ctx;
     AVFormatContext *fmt_ctx = (AVFormatContext *)player->src->format_ctx;
@@ -426,60 +1059,116 @@ static void _HandleAudioPacket(Kit_Player *player, AVPacket *packet) {
         }
 
         if(frame_finished) {
+            // Get pts
+            double pts = 0;
+            if(packet->dts != AV_NOPTS_VALUE) {
+                pts = av_frame_get_best_effort_timestamp(player->tmp_aframe);
+                pts *= av_q2d(fmt_ctx->streams[player->src->astream_idx]->time_base);
+            }
+            player->item_end = FFMAX(player->item_end, pts + (double)aframe->nb_samples / acodec_ctx->sample_rate);
+
+            // Audio past the end of an A-B loop is not needed
+            if(player->loop_end > 0 && pts >= player->loop_end) {
+                _EndLoopPass(player, false);
+                packet->size -= len;
+                packet->data += len;
+                continue;
+            }
+
+            // Exact seek: frames that end before the target never reach the resampler
+            if(player->aseek_target >= 0
+                && pts + (double)aframe->nb_samples / acodec_ctx->sample_rate <= player->aseek_target)
+            {
+                packet->size -= len;
+                packet->data += len;
+                continue;
+            }
+
             dst_nb_samples = av_rescale_rnd(
                 aframe->nb_samples,
                 player->aformat.samplerate,
                 acodec_ctx->sample_rate,
                 AV_ROUND_UP);
 
+            // Stretch or squeeze the frame a little to correct any drift that is not already
+            // being corrected by the packets waiting in the audio buffer.
+            max_comp = dst_nb_samples * AUDIO_DRIFT_MAX_CORRECTION;
+            drift_comp = 0;
+            if(player->sync_master != KIT_SYNC_AUDIO) {
+                // Drift is measured by the audio callback, so read it under the same lock
+                double drift = 0;
+                if(SDL_LockMutex(player->amutex) == 0) {
+                    drift = player->adrift - player->adrift_comp;
+                    SDL_UnlockMutex(player->amutex);
+                }
+                if(fabs(drift) > AUDIO_DRIFT_THRESHOLD) {
+                    int delta = -drift * player->aformat.samplerate;
+                    delta = av_clip(delta, -max_comp, max_comp);
+                    if(swr_set_compensation(swr, delta, dst_nb_samples) == 0) {
+                        drift_comp = -(double)delta / player->aformat.samplerate;
+                    }
+                }
+            }
+
             av_samples_alloc_array_and_samples(
                 &dst_data,
                 &dst_linesize,
                 player->aformat.channels,
-                dst_nb_samples,
+                dst_nb_samples + max_comp,
                 _FindAVSampleFormat(player->aformat.format),
                 0);
 
             len2 = swr_convert(
                 swr,
                 dst_data,
-                aframe->nb_samples,
+                dst_nb_samples + max_comp,
                 (const unsigned char **)aframe->extended_data,
                 aframe->nb_samples);
 
+            // The frame straddling an exact seek target only keeps the samples from the target on.
+            // Output is always packed, so the skipped part is a prefix of dst_data[0].
+            int skip = 0;
+            if(player->aseek_target >= 0) {
+                if(player->aseek_target > pts) {
+                    skip = (player->aseek_target - pts) * player->aformat.samplerate;
+                    skip = av_clip(skip, 0, len2);
+                    len2 -= skip;
+                    pts = player->aseek_target;
+                }
+                player->aseek_target = -1;
+            }
+            unsigned char *dst_start = dst_data[0] + skip * player->aformat.channels * player->aformat.bytes;
+
+            // Likewise, the frame straddling the loop end is cut there
+            if(player->loop_end > 0 && pts + (double)len2 / player->aformat.samplerate > player->loop_end) {
+                len2 = av_clip((player->loop_end - pts) * player->aformat.samplerate, 0, len2);
+            }
+
             dst_bufsize = av_samples_get_buffer_size(
                 &dst_linesize,
                 player->aformat.channels,
                 len2,
                 _FindAVSampleFormat(player->aformat.format), 1);
 
-            // Get pts
-            double pts = 0;
-            if(packet->dts != AV_NOPTS_VALUE) {
-                pts = av_frame_get_best_effort_timestamp(player->tmp_aframe);
-                pts *= av_q2d(fmt_ctx->streams[player->src->astream_idx]->time_base);
+            // Samples inside an A-B loop are recorded, so that later passes need no decoding
+            if(player->loop_end > 0) {
+                if(pts >= player->loop_start) {
+                    _CaptureLoopAudio(player, dst_start, dst_bufsize, len2, pts);
+                }
+                pts += player->loop_offset;
             }
+            pts += player->item_offset;
 
             // Just seeked, set sync clock & pos.
             if(player->seek_flag == 1) {
-                player->vclock_pos = pts;
-                player->clock_sync = _GetSystemTime() - pts;
-                player->seek_flag = 0;
-            }
-
-            // Lock, write to audio buffer, unlock
-            Kit_AudioPacket *apacket = _CreateAudioPacket((char*)dst_data[0], (size_t)dst_bufsize, pts);
-            bool done = false;
-            if(SDL_LockMutex(player->amutex) == 0) {
-                if(Kit_WriteBuffer((Kit_Buffer*)player->abuffer, apacket) == 0) {
-                    done = true;
-                }
-                SDL_UnlockMutex(player->amutex);
+                _FinishSeek(player, pts);
             }
 
-            // Couldn't write packet, free memory
-            if(!done) {
-                _FreeAudioPacket(apacket);
+            // Time stretch if playing at other than normal rate
+            if(player->afilter_graph != NULL) {
+                _FilterAudioData(player, dst_start, len2, pts, drift_comp);
+            } else {
+                _WriteAudioPacket(player, (char*)dst_start, (size_t)dst_bufsize, pts, drift_comp);
             }
 
             av_freep(&dst_data[0]);
@@ -702,7 +1391,7 @@ static void _HandlePacket(Kit_Player *player, AVPacket *packet) {
     if(player->vcodec_ctx != NULL && packet->stream_index == player->src->vstream_idx) {
         _HandleVideoPacket(player, packet);
     }
-    else if(player->acodec_ctx != NULL && packet->stream_index == player->src->astream_idx) {
+    else if(player->acodec_ctx != NULL && packet->stream_index == player->src->astream_idx && !player->dec_scrubbing) {
         _HandleAudioPacket(player, packet);
     }
     else if(player->scodec_ctx != NULL && packet->stream_index == player->src->sstream_idx) {
@@ -714,6 +1403,8 @@ static void _HandleFlushCommand(Kit_Player *player, Kit_ControlPacket *packet) {
     if(player->abuffer != NULL) {
         if(SDL_LockMutex(player->amutex) == 0) {
             Kit_ClearBuffer((Kit_Buffer*)player->abuffer);
+            player->adrift = 0;
+            player->adrift_comp = 0;
             SDL_UnlockMutex(player->amutex);
         }
     }
@@ -730,37 +1421,160 @@ static void _HandleFlushCommand(Kit_Player *player, Kit_ControlPacket *packet) {
         }
     }
     reset_libass_track(player);
+
+    // Drop any samples still inside the time stretcher
+    if(player->afilter_graph != NULL) {
+        _CloseAudioFilter(player);
+        _InitAudioFilter(player, player->dec_rate);
+    }
 }
 
-static void _HandleSeekCommand(Kit_Player *player, Kit_ControlPacket *packet) {
+// Points the replay cursors of a fully recorded loop at the given position
+static void _SeekLoopCache(Kit_LoopCache *cache, double pos) {
+    cache->vpos = 0;
+    while(cache->vpos + 1 < cache->vcount && cache->vframes[cache->vpos + 1].pts <= pos) {
+        cache->vpos++;
+    }
+    cache->apos = 0;
+    while(cache->apos + 1 < cache->acount && cache->achunks[cache->apos + 1].pts <= pos) {
+        cache->apos++;
+    }
+}
+
+static void _SeekTo(Kit_Player *player, double absolute_pos) {
     AVFormatContext *fmt_ctx = (AVFormatContext *)player->src->format_ctx;
 
-    // Find and limit absolute position
-    double seek = packet->value1;
-    double duration = Kit_GetPlayerDuration(player);
-    if(player->vclock_pos + seek <= 0) {
-        seek = -player->vclock_pos;
-    }
-    if(player->vclock_pos + seek >= duration) {
-        seek = duration - player->vclock_pos;
+    // Scrubbing only ever shows keyframes, so there is no point in seeking exactly
+    bool exact = (player->seek_mode == KIT_SEEK_EXACT && !player->dec_scrubbing);
+    _DropPreread(player);
+
+    // While looping, seeks stay inside the loop. A recorded loop needs no demuxing at all,
+    // otherwise recording starts over if the new pass begins at the loop start.
+    bool from_cache = false;
+    if(player->loop_end > 0) {
+        Kit_LoopCache *cache = (Kit_LoopCache*)player->loop_cache;
+        if(absolute_pos < player->loop_start || absolute_pos >= player->loop_end) {
+            absolute_pos = player->loop_start;
+        }
+        player->loop_offset = 0;
+        cache->vdone = false;
+        cache->adone = false;
+        if(cache->complete) {
+            _SeekLoopCache(cache, absolute_pos);
+            from_cache = true;
+            exact = false;
+        } else {
+            _ClearLoopCache(cache);
+            cache->capturing = !cache->too_large && absolute_pos <= player->loop_start;
+        }
     }
-    double absolute_pos = player->vclock_pos + seek;
     int64_t seek_target = absolute_pos * AV_TIME_BASE;
 
-    // Seek to timestamp.
-    avformat_seek_file(fmt_ctx, -1, INT64_MIN, seek_target, INT64_MAX, 0);
-    if(player->vcodec_ctx != NULL)
-        avcodec_flush_buffers(player->vcodec_ctx);
-    if(player->acodec_ctx != NULL)
-        avcodec_flush_buffers(player->acodec_ctx);
+    // Seek to timestamp. Fall back to demuxer seeking if there is no usable keyframe index.
+    // Exact seeks must land at or before the target, so that decoding forward reaches it.
+    // Targets inside the packet window are replayed from memory without touching the demuxer.
+    // Anything else breaks the window's continuity with the demuxer position, so start over.
+    int64_t max_ts = exact ? seek_target : INT64_MAX;
+    if(!from_cache) {
+        if(player->dvr == NULL || Kit_SeekPacketBuffer((Kit_PacketBuffer*)player->dvr, absolute_pos) != 0) {
+            if(player->dvr != NULL) {
+                Kit_ClearPacketBuffer((Kit_PacketBuffer*)player->dvr);
+            }
+            if(_SeekWithIndex(player, absolute_pos) != 0) {
+                avformat_seek_file(fmt_ctx, -1, INT64_MIN, seek_target, max_ts, 0);
+            }
+        }
+        if(player->vcodec_ctx != NULL)
+            avcodec_flush_buffers(player->vcodec_ctx);
+        if(player->acodec_ctx != NULL)
+            avcodec_flush_buffers(player->acodec_ctx);
+    }
+
+    // Stream clocks are stale until new data is handed out
+    player->aclock_time = 0;
+    player->vclock_time = 0;
+
+    // Frames of a previous source, if any, were flushed along with the buffers
+    player->prev_item_offset = player->item_offset;
+
+    // Frames before the requested position are decoded, but not handed out
+    if(exact) {
+        player->vseek_target = absolute_pos;
+        player->aseek_target = absolute_pos;
+    } else {
+        player->vseek_target = -1;
+        player->aseek_target = -1;
+    }
+    player->seek_start = _GetSystemTime();
+    player->seek_pos = absolute_pos;
+
+    // Paused players don't hand out video, but the new position should still be visible
+    if(SDL_LockMutex(player->vmutex) == 0) {
+        player->preview_flag = (player->state == KIT_PAUSED && player->vcodec_ctx != NULL);
+        SDL_UnlockMutex(player->vmutex);
+    }
 
     // On first packet, set clock and current position
     player->seek_flag = 1;
 }
 
-static void _HandleControlPacket(Kit_Player *player, Kit_ControlPacket *packet) {
-    switch(packet->type) {
-        case KIT_CONTROL_FLUSH:
+static void _HandleSeekCommand(Kit_Player *player, Kit_ControlPacket *packet) {
+    // Limit absolute position
+    double absolute_pos = packet->value1;
+    double duration = Kit_GetPlayerDuration(player);
+    if(duration > 0 && absolute_pos >= duration) {
+        absolute_pos = duration;
+    }
+    if(absolute_pos <= 0) {
+        absolute_pos = 0;
+    }
+    _SeekTo(player, absolute_pos);
+}
+
+// Switches between keyframe only scrubbing and normal decoding
+static void _ApplyScrubbing(Kit_Player *player) {
+    bool scrubbing = player->scrubbing;
+    if(scrubbing == player->dec_scrubbing) {
+        return;
+    }
+    AVFormatContext *fmt_ctx = (AVFormatContext *)player->src->format_ctx;
+
+    // Remember where scrubbing started, in case it ends without any seeks. Audio is not
+    // demuxed while scrubbing, so the packet window is dropped and stays empty until it ends.
+    if(scrubbing) {
+        player->seek_pos = player->vclock_pos;
+        if(player->dvr != NULL) {
+            Kit_ClearPacketBuffer((Kit_PacketBuffer*)player->dvr);
+        }
+    }
+
+    if(player->vcodec_ctx != NULL) {
+        AVCodecContext *vcodec_ctx = (AVCodecContext*)player->vcodec_ctx;
+        if(scrubbing) {
+            vcodec_ctx->skip_frame = AVDISCARD_NONKEY;
+        } else {
+            vcodec_ctx->skip_frame = (player->dec_rate > KIT_RATE_SKIP_NONREF) ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+        }
+    }
+
+    // Let the demuxer drop audio altogether, so that it isn't even read where the format allows it
+    if(player->acodec_ctx != NULL) {
+        fmt_ctx->streams[player->src->astream_idx]->discard = scrubbing ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+    }
+
+    player->dec_scrubbing = scrubbing;
+
+    // Frames following the keyframes reference pictures that were never decoded, and audio is
+    // missing. Restart from the last scrubbed position with everything decoded.
+    if(!scrubbing) {
+        _HandleFlushCommand(player, NULL);
+        _SeekTo(player, player->seek_pos);
+    }
+}
+
+static void _HandleControlPacket(Kit_Player *player, Kit_ControlPacket *packet) {
+    switch(packet->type) {
+        case KIT_CONTROL_FLUSH:
             _HandleFlushCommand(player, packet);
             break;
         case KIT_CONTROL_SEEK:
@@ -769,6 +1583,291 @@ static void _HandleControlPacket(Kit_Player *player, Kit_ControlPacket *packet)
     }
 }
 
+// Sets up the packet window as requested. Must be called with cmutex held.
+static void _ApplyDvrWindow(Kit_Player *player) {
+    if(!player->dvr_changed) {
+        return;
+    }
+    player->dvr_changed = false;
+    Kit_DestroyPacketBuffer((Kit_PacketBuffer*)player->dvr);
+    player->dvr = NULL;
+    if(player->dvr_seconds > 0 || player->dvr_megabytes > 0) {
+        // Without a window, seeks just go to the demuxer as before
+        player->dvr = Kit_CreatePacketBuffer(player->dvr_seconds, (size_t)player->dvr_megabytes * 1024 * 1024);
+    }
+}
+
+// Starts or stops an A-B loop as requested. Must be called with cmutex held.
+static void _ApplyLoopSegment(Kit_Player *player) {
+    if(!player->loop_changed) {
+        return;
+    }
+    player->loop_changed = false;
+
+    // Stopping a loop continues from wherever it was
+    double pos = Kit_GetPlayerPosition(player);
+    _FreeLoopCache((Kit_LoopCache*)player->loop_cache);
+    player->loop_cache = NULL;
+    player->loop_end = 0;
+    player->loop_offset = 0;
+    if(player->loop_req_end > player->loop_req_start) {
+        Kit_LoopCache *cache = calloc(1, sizeof(Kit_LoopCache));
+        player->loop_cache = cache;
+        if(cache != NULL) {
+            cache->max_bytes = (size_t)player->loop_cache_megabytes * 1024 * 1024;
+            cache->too_large = (cache->max_bytes == 0);
+            player->loop_start = player->loop_req_start;
+            player->loop_end = player->loop_req_end;
+            pos = player->loop_start;
+        }
+    }
+    _HandleFlushCommand(player, NULL);
+    _SeekTo(player, pos);
+}
+
+// Queues the next recorded frame or audio chunk of the loop, in pts order
+static void _ReplayLoopCache(Kit_Player *player) {
+    Kit_LoopCache *cache = (Kit_LoopCache*)player->loop_cache;
+    double vpts = (cache->vpos < cache->vcount) ? cache->vframes[cache->vpos].pts : INFINITY;
+    double apts = (cache->apos < cache->acount) ? cache->achunks[cache->apos].pts : INFINITY;
+
+    // End of the pass; the next one follows seamlessly on the stream clock
+    if(vpts == INFINITY && apts == INFINITY) {
+        player->loop_offset += player->loop_end - player->loop_start;
+        cache->vpos = 0;
+        cache->apos = 0;
+        return;
+    }
+
+    if(vpts <= apts) {
+        _QueueVideoFrame(player, cache->vframes[cache->vpos++].frame, vpts + player->loop_offset + player->item_offset);
+        return;
+    }
+    Kit_LoopAudioChunk *chunk = &cache->achunks[cache->apos++];
+    double pts = apts + player->loop_offset + player->item_offset;
+    if(player->seek_flag == 1) {
+        _FinishSeek(player, pts);
+    }
+    if(player->afilter_graph != NULL) {
+        _FilterAudioData(player, chunk->data, chunk->nb_samples, pts, 0);
+    } else {
+        _WriteAudioPacket(player, (char*)chunk->data, chunk->len, pts, 0);
+    }
+}
+
+// Blocking source IO gives up once the player is closing, so that the decoder thread can be joined
+static int _PlayerInterrupt(void *opaque) {
+    Kit_Player *player = opaque;
+    if(player->state == KIT_CLOSED) {
+        return 1;
+    }
+    return player->src_interrupt != NULL && player->src_interrupt(player->src_interrupt_opaque);
+}
+
+static void _AttachSource(Kit_Player *player, const Kit_Source *src) {
+    AVFormatContext *format_ctx = (AVFormatContext *)src->format_ctx;
+    player->src_interrupt = format_ctx->interrupt_callback.callback;
+    player->src_interrupt_opaque = format_ctx->interrupt_callback.opaque;
+    format_ctx->interrupt_callback.callback = _PlayerInterrupt;
+    format_ctx->interrupt_callback.opaque = player;
+}
+
+static void _DetachSource(Kit_Player *player, const Kit_Source *src) {
+    AVFormatContext *format_ctx = (AVFormatContext *)src->format_ctx;
+    format_ctx->interrupt_callback.callback = player->src_interrupt;
+    format_ctx->interrupt_callback.opaque = player->src_interrupt_opaque;
+}
+
+static double _GetStartTime(const Kit_Source *src) {
+    AVFormatContext *format_ctx = (AVFormatContext*)src->format_ctx;
+    return (format_ctx->start_time != AV_NOPTS_VALUE) ? (double)format_ctx->start_time / AV_TIME_BASE : 0;
+}
+
+// Moves on to the queued source, or back to the start of the current one when looping. Stream
+// timestamps from there on are offset to follow the end of the current source, so the clocks
+// keep running and what is already buffered plays out without a gap.
+static int _AdvanceSource(Kit_Player *player) {
+    Kit_QueuedItem *item = NULL;
+    if(SDL_LockMutex(player->cmutex) == 0) {
+        item = (Kit_QueuedItem*)player->next_item;
+        player->next_item = NULL;
+        if(item == NULL && !player->looping) {
+            SDL_UnlockMutex(player->cmutex);
+            return 1;
+        }
+
+        // Swap in the decoders of the queued source. Kit_GetPlayerInfo reads these under cmutex.
+        if(item != NULL) {
+            AVCodecContext *acodec_ctx = (AVCodecContext*)player->acodec_ctx;
+            AVCodecContext *vcodec_ctx = (AVCodecContext*)player->vcodec_ctx;
+            AVCodecContext *scodec_ctx = (AVCodecContext*)player->scodec_ctx;
+            if(item->vcodec_ctx != NULL) {
+                item->vcodec_ctx->skip_frame = vcodec_ctx->skip_frame;
+            }
+            if(player->dec_scrubbing && item->src->astream_idx >= 0) {
+                AVFormatContext *old_ctx = (AVFormatContext*)player->src->format_ctx;
+                AVFormatContext *new_ctx = (AVFormatContext*)item->src->format_ctx;
+                old_ctx->streams[player->src->astream_idx]->discard = AVDISCARD_DEFAULT;
+                new_ctx->streams[item->src->astream_idx]->discard = AVDISCARD_ALL;
+            }
+            avcodec_close(acodec_ctx);
+            avcodec_close(vcodec_ctx);
+            avcodec_close(scodec_ctx);
+            avcodec_free_context(&acodec_ctx);
+            avcodec_free_context(&vcodec_ctx);
+            avcodec_free_context(&scodec_ctx);
+            if(player->sws != NULL) {
+                sws_freeContext((struct SwsContext *)player->sws);
+            }
+            swr_free((struct SwrContext **)&player->swr);
+
+            // Subtitles are only shown for the source the player was created with
+            player->acodec_ctx = item->acodec_ctx;
+            player->vcodec_ctx = item->vcodec_ctx;
+            player->scodec_ctx = NULL;
+            player->swr = item->swr;
+            player->sws = item->sws;
+            _DetachSource(player, player->src);
+            _AttachSource(player, item->src);
+            player->src = item->src;
+            player->aformat.stream_idx = item->src->astream_idx;
+            player->vformat.stream_idx = item->src->vstream_idx;
+
+            // Whatever was demuxed ahead of time goes to the decoders before anything else
+            _FreePreread((Kit_Preread*)player->preread);
+            player->preread = NULL;
+            if(item->preread->count > 0) {
+                player->preread = item->preread;
+            } else {
+                free(item->preread);
+            }
+            free(item);
+        }
+        SDL_UnlockMutex(player->cmutex);
+    }
+
+    // Follow on from the end of whatever was decoded last
+    double start = _GetStartTime(player->src);
+    player->prev_item_offset = player->item_offset;
+    player->item_base = player->item_offset + player->item_end;
+    player->item_offset = player->item_base - start;
+    player->item_end = start;
+
+    // Packets of the previous pass or source can't be seeked back into anymore
+    if(player->dvr != NULL) {
+        Kit_ClearPacketBuffer((Kit_PacketBuffer*)player->dvr);
+    }
+    if(item == NULL) {
+        int64_t target = start * AV_TIME_BASE;
+        _DropPreread(player);
+        avformat_seek_file((AVFormatContext*)player->src->format_ctx, -1, INT64_MIN, target, target, 0);
+        if(player->vcodec_ctx != NULL)
+            avcodec_flush_buffers(player->vcodec_ctx);
+        if(player->acodec_ctx != NULL)
+            avcodec_flush_buffers(player->acodec_ctx);
+        if(player->scodec_ctx != NULL)
+            avcodec_flush_buffers(player->scodec_ctx);
+    }
+    player->vseek_target = -1;
+    player->aseek_target = -1;
+    return 0;
+}
+
+// Keeps a reference to a freshly demuxed packet in the packet window
+static void _BufferPacket(Kit_Player *player, const AVPacket *packet) {
+    Kit_PacketBuffer *dvr = (Kit_PacketBuffer*)player->dvr;
+    AVFormatContext *fmt_ctx = (AVFormatContext *)player->src->format_ctx;
+    int idx = packet->stream_index;
+
+    // While scrubbing, only video keyframes are demuxed. A window of those can't be played back
+    // with audio, so nothing is collected until normal decoding resumes.
+    if(dvr == NULL || player->dec_scrubbing) {
+        return;
+    }
+    if(!((player->vcodec_ctx != NULL && idx == player->src->vstream_idx)
+        || (player->acodec_ctx != NULL && idx == player->src->astream_idx)
+        || (player->scodec_ctx != NULL && idx == player->src->sstream_idx)))
+    {
+        return;
+    }
+
+    // Packets without timestamps sit at the time of the one before them
+    double pts = 0;
+    int64_t ts = (packet->pts != AV_NOPTS_VALUE) ? packet->pts : packet->dts;
+    if(ts != AV_NOPTS_VALUE) {
+        pts = ts * av_q2d(fmt_ctx->streams[idx]->time_base);
+    } else if(dvr->count > 0) {
+        pts = dvr->packets[dvr->head + dvr->count - 1].pts;
+    }
+
+    // Replay starts from keyframes of the video, or any packet of audio only sources
+    int anchor_idx = (player->vcodec_ctx != NULL) ? player->src->vstream_idx : player->src->astream_idx;
+    bool is_anchor = (idx == anchor_idx) && (packet->flags & AV_PKT_FLAG_KEY);
+
+    // A window with a hole in it can't be replayed; start collecting again from here
+    if(Kit_WritePacketBuffer(dvr, packet, pts, is_anchor) != 0) {
+        Kit_ClearPacketBuffer(dvr);
+    }
+}
+
+// Demuxes the start of the queued source while the buffers are full, so that it can take over
+// at the end of the current one without waiting on IO. Kit_QueuePlayerSource frees replaced
+// items under cmutex, so the read happens with it held; one packet per call keeps that short.
+static void _PrereadQueuedSource(Kit_Player *player) {
+    if(SDL_LockMutex(player->cmutex) != 0) {
+        return;
+    }
+    Kit_QueuedItem *item = (Kit_QueuedItem*)player->next_item;
+    if(item == NULL || item->src == player->src || item->preread->done) {
+        SDL_UnlockMutex(player->cmutex);
+        return;
+    }
+    Kit_Preread *preread = item->preread;
+    const Kit_Source *src = item->src;
+    AVPacket *packet = av_packet_alloc();
+    int ret = AVERROR(ENOMEM);
+    if(packet != NULL) {
+        ret = av_read_frame((AVFormatContext*)src->format_ctx, packet);
+    }
+
+    // Errors and the end of the source are left for the switch to run into and handle
+    if(ret < 0) {
+        preread->done = (ret != AVERROR(EAGAIN));
+        av_packet_free(&packet);
+    } else if((item->vcodec_ctx != NULL && packet->stream_index == src->vstream_idx)
+        || (item->acodec_ctx != NULL && packet->stream_index == src->astream_idx))
+    {
+        // Stop at the keyframe starting the second GOP. The demuxer is past it, so it's kept too.
+        if(item->vcodec_ctx != NULL && packet->stream_index == src->vstream_idx && (packet->flags & AV_PKT_FLAG_KEY)) {
+            preread->done = preread->keyframe;
+            preread->keyframe = true;
+        }
+        preread->packets[preread->count++] = packet;
+        if(preread->count == KIT_PREREAD_PACKETS) {
+            preread->done = true;
+        }
+    } else {
+        av_packet_free(&packet);
+    }
+    SDL_UnlockMutex(player->cmutex);
+}
+
+// Hands out the next packet that was demuxed before the current source took over, if any are left
+static int _TakePrereadPacket(Kit_Player *player, AVPacket *packet) {
+    Kit_Preread *preread = (Kit_Preread*)player->preread;
+    if(preread == NULL) {
+        return 1;
+    }
+    av_packet_move_ref(packet, preread->packets[preread->pos]);
+    av_packet_free(&preread->packets[preread->pos]);
+    preread->pos++;
+    if(preread->pos >= preread->count) {
+        _FreePreread(preread);
+        player->preread = NULL;
+    }
+    return 0;
+}
+
 // Return 0 if stream is good but nothing else to do for now
 // Return -1 if there is still work to be done
 // Return 1 if there was an error or stream end
@@ -780,6 +1879,8 @@ static int _UpdatePlayer(Kit_Player *player) {
     // Handle control queue
     if(SDL_LockMutex(player->cmutex) == 0) {
         Kit_ControlPacket *cpacket;
+        _ApplyDvrWindow(player);
+        _ApplyLoopSegment(player);
         while((cpacket = (Kit_ControlPacket*)Kit_ReadBuffer(player->cbuffer)) != NULL) {
             _HandleControlPacket(player, cpacket);
             _FreeControlPacket(cpacket);
@@ -787,32 +1888,71 @@ static int _UpdatePlayer(Kit_Player *player) {
         SDL_UnlockMutex(player->cmutex);
     }
 
+    // Pick up playback rate and scrubbing changes
+    _ApplyPlaybackRate(player);
+    _ApplyScrubbing(player);
+
     // If either buffer is full, just stop here for now.
     // Since we don't know what kind of data is going to come out of av_read_frame, we really
     // want to make sure we are prepared for everything :)
-    if(player->vcodec_ctx != NULL) {
+    // Live sources are read as fast as data comes in; full buffers drop old data instead.
+    if(player->vcodec_ctx != NULL && !player->src->is_live) {
         if(SDL_LockMutex(player->vmutex) == 0) {
             int ret = Kit_IsBufferFull(player->vbuffer);
             SDL_UnlockMutex(player->vmutex);
             if(ret == 1) {
+                _PrereadQueuedSource(player);
                 return 0;
             }
         }
     }
-    if(player->acodec_ctx != NULL) {
+    // Audio isn't consumed while paused. Don't let it hold back the preview frame after a seek;
+    // audio that doesn't fit is dropped, and playback resumes with video until it catches up.
+    if(player->acodec_ctx != NULL && !player->src->is_live && !player->preview_flag) {
         if(SDL_LockMutex(player->amutex) == 0) {
             int ret = Kit_IsBufferFull(player->abuffer);
             SDL_UnlockMutex(player->amutex);
             if(ret == 1) {
+                _PrereadQueuedSource(player);
                 return 0;
             }
         }
     }
 
-    // Attempt to read frame. Just return here if it fails.
+    // Recorded A-B loops are played back without any demuxing or decoding
+    if(player->loop_end > 0 && ((Kit_LoopCache*)player->loop_cache)->complete) {
+        _ReplayLoopCache(player);
+        return -1;
+    }
+
+    // Replay from the packet window after a seek into it. Otherwise take what was read ahead of
+    // the switch to this source, or attempt to read frame, and just return here if it fails.
     AVPacket packet;
-    if(av_read_frame(format_ctx, &packet) < 0) {
-        return 1;
+    if(player->dvr == NULL || Kit_ReadPacketBuffer((Kit_PacketBuffer*)player->dvr, &packet) != 0) {
+        int ret = 0;
+        if(_TakePrereadPacket(player, &packet) != 0) {
+            ret = av_read_frame(format_ctx, &packet);
+        }
+        if(ret == AVERROR(EAGAIN)) {
+            return 0;
+        }
+        if(ret < 0) {
+            // Anything but the end of the file is a read error, and playback can't go on.
+            // Some demuxers report the end as an IO error, so check the IO context as well.
+            if(ret != AVERROR_EOF && (format_ctx->pb == NULL || !avio_feof(format_ctx->pb))) {
+                return 1;
+            }
+
+            // A loop reaching past the end of the file ends its pass here
+            if(player->loop_end > 0) {
+                ((Kit_LoopCache*)player->loop_cache)->adone = true;
+                if(_EndLoopPass(player, true) == 0) {
+                    return -1;
+                }
+            }
+            return _AdvanceSource(player) == 0 ? -1 : 1;
+        }
+        _BufferPacket(player, &packet);
     }
     _HandlePacket(player, &packet);
     av_packet_unref(&packet);
@@ -844,8 +1984,9 @@ static int _DecoderThread(void *ptr) {
             }
 
             // Get more data from demuxer, decode. Wait a bit if there's no more work for now.
+            // Reads interrupted by Kit_ClosePlayer fail too; don't let those undo the close.
             ret = _UpdatePlayer(player);
-            if(ret == 1) {
+            if(ret == 1 && player->state != KIT_CLOSED) {
                 player->state = KIT_STOPPED;
             } else if(ret == 0) {
                 SDL_Delay(1);
@@ -894,10 +2035,24 @@ Kit_Player* Kit_CreatePlayer(const Kit_Source *src) {
     AVCodecContext *vcodec_ctx = NULL;
     AVCodecContext *scodec_ctx = NULL;
 
+    player->rate = 1.0;
+    player->loop_cache_megabytes = KIT_LOOP_DEFAULT_MEGABYTES;
+    player->dec_rate = 1.0;
+    player->vseek_target = -1;
+    player->aseek_target = -1;
+
+    // Live streams don't start from zero, so sync the clock to the first frame. Latency is
+    // controlled by dropping data as it arrives, so pace by system time.
+    if(src->is_live) {
+        player->sync_master = KIT_SYNC_EXTERNAL;
+        player->seek_flag = 1;
+    }
+
     // Initialize codecs
-    if(_InitCodecs(player, src) != 0) {
+    if(_InitCodecs(src, &player->acodec_ctx, &player->vcodec_ctx, &player->scodec_ctx) != 0) {
         goto error;
     }
+    player->src = src;
 
     // Init audio codec information if audio codec is initialized
     acodec_ctx = (AVCodecContext*)player->acodec_ctx;
@@ -908,21 +2063,14 @@ Kit_Player* Kit_CreatePlayer(const Kit_Source *src) {
         player->aformat.stream_idx = src->astream_idx;
         _FindAudioFormat(acodec_ctx->sample_fmt, &player->aformat.bytes, &player->aformat.is_signed, &player->aformat.format);
 
-        player->swr = swr_alloc_set_opts(
-            NULL,
-            _FindAVChannelLayout(player->aformat.channels), // Target channel layout
-            _FindAVSampleFormat(player->aformat.format), // Target fmt
-            player->aformat.samplerate, // Target samplerate
-            acodec_ctx->channel_layout, // Source channel layout
-            acodec_ctx->sample_fmt, // Source fmt
-            acodec_ctx->sample_rate, // Source samplerate
-            0, NULL);
-        if(swr_init((struct SwrContext *)player->swr) != 0) {
-            Kit_SetError("Unable to initialize audio converter context");
+        player->swr = _CreateResampler(player, acodec_ctx);
+        if(player->swr == NULL) {
             goto error;
         }
 
-        player->abuffer = Kit_CreateBuffer(KIT_ABUFFERSIZE, _FreeAudioPacket);
+        player->abuffer = Kit_CreateBuffer(
+            src->is_live ? KIT_ABUFFERSIZE_LIVE : KIT_ABUFFERSIZE,
+            _FreeAudioPacket);
         if(player->abuffer == NULL) {
             Kit_SetError("Unable to initialize audio ringbuffer");
             goto error;
@@ -944,21 +2092,14 @@ Kit_Player* Kit_CreatePlayer(const Kit_Source *src) {
         player->vformat.stream_idx = src->vstream_idx;
         _FindPixelFormat(vcodec_ctx->pix_fmt, &player->vformat.format);
 
-        player->sws = sws_getContext(
-            vcodec_ctx->width, // Source w
-            vcodec_ctx->height, // Source h
-            vcodec_ctx->pix_fmt, // Source fmt
-            vcodec_ctx->width, // Target w
-            vcodec_ctx->height, // Target h
-            _FindAVPixelFormat(player->vformat.format), // Target fmt
-            SWS_BICUBIC,
-            NULL, NULL, NULL);
-        if((struct SwsContext *)player->sws == NULL) {
-            Kit_SetError("Unable to initialize video converter context");
+        player->sws = _CreateScaler(player, vcodec_ctx);
+        if(player->sws == NULL) {
             goto error;
         }
 
-        player->vbuffer = Kit_CreateBuffer(KIT_VBUFFERSIZE, _FreeVideoPacket);
+        player->vbuffer = Kit_CreateBuffer(
+            src->is_live ? KIT_VBUFFERSIZE_LIVE : KIT_VBUFFERSIZE,
+            _FreeVideoPacket);
         if(player->vbuffer == NULL) {
             Kit_SetError("Unable to initialize video ringbuffer");
             goto error;
@@ -1063,9 +2204,11 @@ Kit_Player* Kit_CreatePlayer(const Kit_Source *src) {
         goto error;
     }
 
+    _AttachSource(player, src);
     player->dec_thread = SDL_CreateThread(_DecoderThread, "Kit Decoder Thread", player);
     if(player->dec_thread == NULL) {
         Kit_SetError("Unable to create a decoder thread: %s", SDL_GetError());
+        _DetachSource(player, src);
         goto error;
     }
 
@@ -1102,6 +2245,7 @@ error:
     if(player->swr != NULL) {
         swr_free((struct SwrContext **)player->swr);
     }
+    _CloseAudioFilter(player);
 
     if(player->ass_track != NULL) {
         ass_free_track((ASS_Track*)player->ass_track);
@@ -1118,9 +2262,10 @@ error:
 void Kit_ClosePlayer(Kit_Player *player) {
     if(player == NULL) return;
 
-    // Kill the decoder thread
+    // Kill the decoder thread. Source IO that is stuck waiting is interrupted.
     player->state = KIT_CLOSED;
     SDL_WaitThread(player->dec_thread, NULL);
+    _DetachSource(player, player->src);
     SDL_DestroyMutex(player->vmutex);
     SDL_DestroyMutex(player->amutex);
     SDL_DestroyMutex(player->cmutex);
@@ -1133,6 +2278,7 @@ void Kit_ClosePlayer(Kit_Player *player) {
     if(player->swr != NULL) {
         swr_free((struct SwrContext **)&player->swr);
     }
+    _CloseAudioFilter(player);
 
     // Free temporary frames
     if(player->tmp_vframe != NULL) {
@@ -1151,6 +2297,10 @@ void Kit_ClosePlayer(Kit_Player *player) {
     avcodec_free_context((AVCodecContext**)&player->scodec_ctx);
 
     // Free local audio buffers
+    _FreeQueuedItem((Kit_QueuedItem*)player->next_item);
+    _FreePreread((Kit_Preread*)player->preread);
+    _FreeLoopCache((Kit_LoopCache*)player->loop_cache);
+    Kit_DestroyPacketBuffer((Kit_PacketBuffer*)player->dvr);
     Kit_DestroyBuffer((Kit_Buffer*)player->cbuffer);
     Kit_DestroyBuffer((Kit_Buffer*)player->abuffer);
     Kit_DestroyBuffer((Kit_Buffer*)player->vbuffer);
@@ -1168,6 +2318,60 @@ void Kit_ClosePlayer(Kit_Player *player) {
     free(player);
 }
 
+// When video is the master, frames are paced by system time and the rest follow video.
+static double _GetVideoSyncClock(const Kit_Player *player) {
+    if(player->sync_master == KIT_SYNC_VIDEO) {
+        return _GetExternalClock(player);
+    }
+    return _GetMasterClock(player);
+}
+
+// Updates the texture from the given (already dequeued) packet, and frees the packet.
+static void _PresentVideoPacket(Kit_Player *player, SDL_Texture *texture, Kit_VideoPacket *packet) {
+    player->vclock_pos = packet->pts;
+    player->vclock_time = _GetSystemTime();
+
+    // Update textures as required. Handle UYV frames separately.
+    if(player->vformat.format == SDL_PIXELFORMAT_YV12
+        || player->vformat.format == SDL_PIXELFORMAT_IYUV)
+    {
+        SDL_UpdateYUVTexture(
+            texture, NULL,
+            packet->frame->data[0], packet->frame->linesize[0],
+            packet->frame->data[1], packet->frame->linesize[1],
+            packet->frame->data[2], packet->frame->linesize[2]);
+    }
+    else {
+        SDL_UpdateTexture(
+            texture, NULL,
+            packet->frame->data[0],
+            packet->frame->linesize[0]);
+    }
+
+    _FreeVideoPacket(packet);
+}
+
+// Shows the first frame after a seek made while paused, regardless of the clocks
+static int _PresentPreviewFrame(Kit_Player *player, SDL_Texture *texture) {
+    if(SDL_LockMutex(player->vmutex) != 0) {
+        Kit_SetError("Unable to lock video buffer mutex");
+        return 1;
+    }
+    if(player->preview_flag) {
+        Kit_VideoPacket *packet = (Kit_VideoPacket*)Kit_PeekBuffer((Kit_Buffer*)player->vbuffer);
+        if(packet != NULL) {
+            Kit_AdvanceBuffer((Kit_Buffer*)player->vbuffer);
+            _PresentVideoPacket(player, texture, packet);
+
+            // Resuming moves the clock forwards by the time spent paused
+            player->vclock_time = player->pause_start;
+            player->preview_flag = false;
+        }
+    }
+    SDL_UnlockMutex(player->vmutex);
+    return 0;
+}
+
 int Kit_GetVideoData(Kit_Player *player, SDL_Texture *texture) {
     assert(player != NULL);
 
@@ -1177,9 +2381,9 @@ int Kit_GetVideoData(Kit_Player *player, SDL_Texture *texture) {
 
     assert(texture != NULL);
 
-    // If paused or stopped, do nothing
+    // If paused or stopped, do nothing. Seeking while paused still updates the picture once.
     if(player->state == KIT_PAUSED) {
-        return 0;
+        return _PresentPreviewFrame(player, texture);
     }
     if(player->state == KIT_STOPPED) {
         return 0;
@@ -1195,8 +2399,7 @@ int Kit_GetVideoData(Kit_Player *player, SDL_Texture *texture) {
             return 0;
         }
 
-        // Print some data
-        double cur_video_ts = _GetSystemTime() - player->clock_sync;
+        double cur_video_ts = _GetVideoSyncClock(player);
 
         // Check if we want the packet
         if(packet->pts > cur_video_ts + VIDEO_SYNC_THRESHOLD) {
@@ -1221,26 +2424,59 @@ int Kit_GetVideoData(Kit_Player *player, SDL_Texture *texture) {
 
         // Advance buffer one frame forwards
         Kit_AdvanceBuffer((Kit_Buffer*)player->vbuffer);
-        player->vclock_pos = packet->pts;
-
-        // Update textures as required. Handle UYV frames separately.
-        if(player->vformat.format == SDL_PIXELFORMAT_YV12
-            || player->vformat.format == SDL_PIXELFORMAT_IYUV)
-        {
-            SDL_UpdateYUVTexture(
-                texture, NULL, 
-                packet->frame->data[0], packet->frame->linesize[0],
-                packet->frame->data[1], packet->frame->linesize[1],
-                packet->frame->data[2], packet->frame->linesize[2]);
-        } 
-        else {
-            SDL_UpdateTexture(
-                texture, NULL,
-                packet->frame->data[0],
-                packet->frame->linesize[0]);
-        }
-
-        _FreeVideoPacket(packet);
+        _PresentVideoPacket(player, texture, packet);
+        SDL_UnlockMutex(player->vmutex);
+    } else {
+        Kit_SetError("Unable to lock video buffer mutex");
+        return 1;
+    }
+
+    return 0;
+}
+
+int Kit_GetVideoDataForDisplay(Kit_Player *player, SDL_Texture *texture, double display_delay) {
+    assert(player != NULL);
+
+    if(player->src->vstream_idx == -1) {
+        return 0;
+    }
+
+    assert(texture != NULL);
+
+    // If paused or stopped, do nothing. Seeking while paused still updates the picture once.
+    if(player->state == KIT_PAUSED) {
+        return _PresentPreviewFrame(player, texture);
+    }
+    if(player->state == KIT_STOPPED) {
+        return 0;
+    }
+
+    Kit_VideoPacket *packet = NULL;
+    Kit_VideoPacket *n_packet = NULL;
+    if(SDL_LockMutex(player->vmutex) == 0) {
+        // Stream time at the moment the frame actually becomes visible
+        double display_ts = _GetVideoSyncClock(player) + display_delay * player->rate;
+
+        // Nothing is due by then, keep showing the current frame.
+        packet = (Kit_VideoPacket*)Kit_PeekBuffer((Kit_Buffer*)player->vbuffer);
+        if(packet == NULL || packet->pts > display_ts) {
+            SDL_UnlockMutex(player->vmutex);
+            return 0;
+        }
+
+        // Show the last frame that has started by display time. Every frame is shown for
+        // whole display refreshes only, so there's no threshold to jitter around.
+        while(1) {
+            Kit_AdvanceBuffer((Kit_Buffer*)player->vbuffer);
+            n_packet = (Kit_VideoPacket*)Kit_PeekBuffer((Kit_Buffer*)player->vbuffer);
+            if(n_packet == NULL || n_packet->pts > display_ts) {
+                break;
+            }
+            _FreeVideoPacket(packet);
+            packet = n_packet;
+        }
+
+        _PresentVideoPacket(player, texture, packet);
         SDL_UnlockMutex(player->vmutex);
     } else {
         Kit_SetError("Unable to lock video buffer mutex");
@@ -1250,6 +2486,33 @@ int Kit_GetVideoData(Kit_Player *player, SDL_Texture *texture) {
     return 0;
 }
 
+int Kit_GetNextVideoFrameTime(Kit_Player *player, double *pts, double *delay) {
+    assert(player != NULL);
+
+    int ret = 1;
+    if(player->src->vstream_idx == -1) {
+        return ret;
+    }
+
+    if(SDL_LockMutex(player->vmutex) == 0) {
+        Kit_VideoPacket *packet = (Kit_VideoPacket*)Kit_PeekBuffer((Kit_Buffer*)player->vbuffer);
+        if(packet != NULL) {
+            if(pts != NULL) {
+                *pts = packet->pts;
+            }
+            if(delay != NULL) {
+                *delay = (packet->pts - _GetVideoSyncClock(player)) / player->rate;
+            }
+            ret = 0;
+        }
+        SDL_UnlockMutex(player->vmutex);
+    } else {
+        Kit_SetError("Unable to lock video buffer mutex");
+    }
+
+    return ret;
+}
+
 int Kit_GetSubtitleData(Kit_Player *player, SDL_Renderer *renderer) {
     assert(player != NULL);
 
@@ -1272,7 +2535,7 @@ int Kit_GetSubtitleData(Kit_Player *player, SDL_Renderer *renderer) {
     Kit_SubtitlePacket *packet = NULL;
 
     // Current sync timestamp
-    double cur_subtitle_ts = _GetSystemTime() - player->clock_sync;
+    double cur_subtitle_ts = _GetMasterClock(player);
 
     // Read a packet from buffer, if one exists. Stop here if not.
     if(SDL_LockMutex(player->smutex) == 0) {
@@ -1330,7 +2593,6 @@ int Kit_GetAudioData(Kit_Player *player, unsigned char *buffer, int length, int
     // Read a packet from buffer, if one exists. Stop here if not.
     int ret = 0;
     Kit_AudioPacket *packet = NULL;
-    Kit_AudioPacket *n_packet = NULL;
     if(SDL_LockMutex(player->amutex) == 0) {
         packet = (Kit_AudioPacket*)Kit_PeekBuffer((Kit_Buffer*)player->abuffer);
         if(packet == NULL) {
@@ -1338,14 +2600,20 @@ int Kit_GetAudioData(Kit_Player *player, unsigned char *buffer, int length, int
             return 0;
         }
 
+        // Audio is time stretched by playback rate, so count bytes per second of stream time. Packets
+        // made before a rate change are still stretched at the old rate, so use the packet's own rate.
         int bytes_per_sample = player->aformat.bytes * player->aformat.channels;
-        double bps = bytes_per_sample * player->aformat.samplerate;
-        double cur_audio_ts = _GetSystemTime() - player->clock_sync + ((double)cur_buf_len / bps);
+        double bps = bytes_per_sample * player->aformat.samplerate / packet->rate;
+        bool is_master = (player->sync_master == KIT_SYNC_AUDIO);
+        double cur_audio_ts = _GetMasterClock(player) + ((double)cur_buf_len / bps);
         double diff = cur_audio_ts - packet->pts;
-        int diff_samples = fabs(diff) * player->aformat.samplerate;
-        
-        if(packet->pts > cur_audio_ts + AUDIO_SYNC_THRESHOLD) {
+        int diff_samples = fabs(diff) * player->aformat.samplerate / packet->rate;
+
+        if(is_master) {
+            // Audio is the clock, so there is nothing to sync against.
+        } else if(packet->pts > cur_audio_ts + AUDIO_SYNC_THRESHOLD) {
             // Audio is ahead, fill buffer with some silence
+            player->adrift = 0;
             int max_diff_samples = length / bytes_per_sample;
             int max_samples = (max_diff_samples < diff_samples) ? max_diff_samples : diff_samples;
 
@@ -1363,27 +2631,35 @@ int Kit_GetAudioData(Kit_Player *player, unsigned char *buffer, int length, int
 
         } else if(packet->pts < cur_audio_ts - AUDIO_SYNC_THRESHOLD) {
             // Audio is lagging, skip until good pts is found
-
-            while(1) {
+            player->adrift = 0;
+            while(packet != NULL && packet->pts < cur_audio_ts - AUDIO_SYNC_THRESHOLD) {
                 Kit_AdvanceBuffer((Kit_Buffer*)player->abuffer);
-                n_packet = (Kit_AudioPacket*)Kit_PeekBuffer((Kit_Buffer*)player->abuffer);
-                if(n_packet != NULL) {
-                    packet = n_packet;
-                } else {
-                    break;
-                }
-                if(packet->pts > cur_audio_ts - AUDIO_SYNC_THRESHOLD) {
-                    break;
-                }
+                player->adrift_comp -= packet->drift_comp;
+                _FreeAudioPacket(packet);
+                packet = (Kit_AudioPacket*)Kit_PeekBuffer((Kit_Buffer*)player->abuffer);
+            }
+            if(packet == NULL) {
+                SDL_UnlockMutex(player->amutex);
+                return 0;
             }
+            bps = bytes_per_sample * player->aformat.samplerate / packet->rate;
+        } else {
+            // Small drift; let the decoder correct it smoothly via resampling.
+            player->adrift = AUDIO_DRIFT_AVG_COEF * player->adrift + (1.0 - AUDIO_DRIFT_AVG_COEF) * diff;
         }
 
+        // Audio clock is the pts currently coming out of the device; that is, the start of
+        // this chunk minus whatever the caller still has queued up before it.
+        player->aclock_pos = packet->pts - ((double)cur_buf_len / bps);
+        player->aclock_time = _GetSystemTime();
+
         if(length > 0) {
             ret = Kit_ReadRingBuffer(packet->rb, (char*)buffer, length);
         }
 
         if(Kit_GetRingBufferLength(packet->rb) == 0) {
             Kit_AdvanceBuffer((Kit_Buffer*)player->abuffer);
+            player->adrift_comp -= packet->drift_comp;
             _FreeAudioPacket(packet);
         } else {
             double adjust = (double)ret / bps;
@@ -1403,13 +2679,17 @@ void Kit_GetPlayerInfo(const Kit_Player *player, Kit_PlayerInfo *info) {
     assert(player != NULL);
     assert(info != NULL);
 
+    // Reset everything to 0. We might not fill all fields.
+    memset(info, 0, sizeof(Kit_PlayerInfo));
+
+    // Decoders are swapped under cmutex when playback moves on to a queued source
+    if(SDL_LockMutex(player->cmutex) != 0) {
+        return;
+    }
     AVCodecContext *acodec_ctx = (AVCodecContext*)player->acodec_ctx;
     AVCodecContext *vcodec_ctx = (AVCodecContext*)player->vcodec_ctx;
     AVCodecContext *scodec_ctx = (AVCodecContext*)player->scodec_ctx;
 
-    // Reset everything to 0. We might not fill all fields.
-    memset(info, 0, sizeof(Kit_PlayerInfo));
-
     if(acodec_ctx != NULL) {
         strncpy(info->acodec, acodec_ctx->codec->name, KIT_CODECMAX-1);
         strncpy(info->acodec_name, acodec_ctx->codec->long_name, KIT_CODECNAMEMAX-1);
@@ -1425,6 +2705,7 @@ void Kit_GetPlayerInfo(const Kit_Player *player, Kit_PlayerInfo *info) {
         strncpy(info->scodec_name, scodec_ctx->codec->long_name, KIT_CODECNAMEMAX-1);
         memcpy(&info->subtitle, &player->sformat, sizeof(Kit_SubtitleFormat));
     }
+    SDL_UnlockMutex(player->cmutex);
 }
 
 Kit_PlayerState Kit_GetPlayerState(const Kit_Player *player) {
@@ -1443,7 +2724,20 @@ void Kit_PlayerPlay(Kit_Player *player) {
         player->clock_sync = _GetSystemTime();
     }
     if(player->state == KIT_PAUSED) {
-        player->clock_sync += _GetSystemTime() - player->pause_start;
+        double paused = _GetSystemTime() - player->pause_start;
+        player->clock_sync += paused;
+        if(player->aclock_time > 0) {
+            player->aclock_time += paused;
+        }
+        if(player->vclock_time > 0) {
+            player->vclock_time += paused;
+        }
+
+        // Preview frame that was not picked up in time is just played normally
+        if(SDL_LockMutex(player->vmutex) == 0) {
+            player->preview_flag = false;
+            SDL_UnlockMutex(player->vmutex);
+        }
     }
     player->state = KIT_PLAYING;
 }
@@ -1467,32 +2761,328 @@ void Kit_PlayerPause(Kit_Player *player) {
     player->state = KIT_PAUSED;
 }
 
+void Kit_SetPlayerSyncMaster(Kit_Player *player, Kit_SyncMaster master) {
+    assert(player != NULL);
+
+    // Start the new master from where the current one is, so that switching doesn't jump.
+    _SetExternalClock(player, _GetMasterClock(player));
+    player->sync_master = master;
+}
+
+Kit_SyncMaster Kit_GetPlayerSyncMaster(const Kit_Player *player) {
+    assert(player != NULL);
+
+    return player->sync_master;
+}
+
+int Kit_SetPlaybackRate(Kit_Player *player, double rate) {
+    assert(player != NULL);
+
+    if(rate < KIT_RATE_MIN || rate > KIT_RATE_MAX) {
+        Kit_SetError("Playback rate must be between %.2f and %.2f", KIT_RATE_MIN, KIT_RATE_MAX);
+        return 1;
+    }
+
+    // The audio callback and video getters read the clocks under their own locks
+    if(SDL_LockMutex(player->amutex) != 0) {
+        Kit_SetError("Unable to lock audio buffer mutex");
+        return 1;
+    }
+    if(SDL_LockMutex(player->vmutex) != 0) {
+        SDL_UnlockMutex(player->amutex);
+        Kit_SetError("Unable to lock video buffer mutex");
+        return 1;
+    }
+
+    // Keep all clocks where they are now, and continue from there at the new rate. While paused,
+    // the clocks stopped at the pause beginning; resuming shifts them by the pause itself.
+    double now = (player->state == KIT_PAUSED) ? player->pause_start : _GetSystemTime();
+    double clock = (now - player->clock_sync) * player->rate;
+    if(player->aclock_time > 0) {
+        player->aclock_pos += (now - player->aclock_time) * player->rate;
+        player->aclock_time = now;
+    }
+    if(player->vclock_time > 0) {
+        player->vclock_pos += (now - player->vclock_time) * player->rate;
+        player->vclock_time = now;
+    }
+    player->rate = rate;
+    player->clock_sync = now - clock / rate;
+    SDL_UnlockMutex(player->vmutex);
+    SDL_UnlockMutex(player->amutex);
+    return 0;
+}
+
+double Kit_GetPlaybackRate(const Kit_Player *player) {
+    assert(player != NULL);
+
+    return player->rate;
+}
+
+// Queues a seek to an absolute position. Must be called with cmutex held.
+static int _QueueSeek(Kit_Player *player, double absolute_pos) {
+    // The control queue only ever carries seeks, and only the latest one matters. Drop
+    // whatever the decoder thread hasn't gotten to yet, so that rapid seeks don't pile up.
+    Kit_ClearBuffer((Kit_Buffer*)player->cbuffer);
+
+    // Flush audio and video buffers, then set seek
+    Kit_ControlPacket *flush = _CreateControlPacket(KIT_CONTROL_FLUSH, 0);
+    if(Kit_WriteBuffer((Kit_Buffer*)player->cbuffer, flush) != 0) {
+        _FreeControlPacket(flush);
+        Kit_SetError("Unable to queue seek");
+        return 1;
+    }
+    Kit_ControlPacket *seek = _CreateControlPacket(KIT_CONTROL_SEEK, absolute_pos);
+    if(Kit_WriteBuffer((Kit_Buffer*)player->cbuffer, seek) != 0) {
+        _FreeControlPacket(seek);
+        Kit_SetError("Unable to queue seek");
+        return 1;
+    }
+    player->seek_request = absolute_pos;
+    return 0;
+}
+
 int Kit_PlayerSeek(Kit_Player *player, double m_time) {
     assert(player != NULL);
 
-    // Send packets to control stream
-    if(SDL_LockMutex(player->cmutex) == 0) {
-        // Flush audio and video buffers, then set seek, then unlock control queue mutex.
-        Kit_WriteBuffer((Kit_Buffer*)player->cbuffer, _CreateControlPacket(KIT_CONTROL_FLUSH, 0));
-        Kit_WriteBuffer((Kit_Buffer*)player->cbuffer, _CreateControlPacket(KIT_CONTROL_SEEK, m_time));
-        SDL_UnlockMutex(player->cmutex);
-    } else {
+    if(SDL_LockMutex(player->cmutex) != 0) {
         Kit_SetError("Unable to lock control queue mutex");
         return 1;
     }
 
+    // Seek relative to where the player is headed. Until the first frame after a seek is out,
+    // the clocks still point to the old position.
+    double base = Kit_GetPlayerPosition(player);
+    if(Kit_PeekBuffer((Kit_Buffer*)player->cbuffer) != NULL) {
+        base = player->seek_request;
+    } else if(player->seek_flag == 1) {
+        base = player->seek_pos;
+    }
+    int ret = _QueueSeek(player, base + m_time);
+    SDL_UnlockMutex(player->cmutex);
+    return ret;
+}
+
+int Kit_PlayerSeekTo(Kit_Player *player, double m_time) {
+    assert(player != NULL);
+
+    if(SDL_LockMutex(player->cmutex) != 0) {
+        Kit_SetError("Unable to lock control queue mutex");
+        return 1;
+    }
+    int ret = _QueueSeek(player, m_time);
+    SDL_UnlockMutex(player->cmutex);
+    return ret;
+}
+
+void Kit_SetPlayerSeekMode(Kit_Player *player, Kit_SeekMode mode) {
+    assert(player != NULL);
+
+    // Takes effect on the next seek
+    player->seek_mode = mode;
+}
+
+Kit_SeekMode Kit_GetPlayerSeekMode(const Kit_Player *player) {
+    assert(player != NULL);
+
+    return player->seek_mode;
+}
+
+double Kit_GetPlayerSeekTime(const Kit_Player *player) {
+    assert(player != NULL);
+
+    return player->seek_time;
+}
+
+void Kit_SetPlayerScrubbing(Kit_Player *player, bool scrubbing) {
+    assert(player != NULL);
+
+    // Picked up by the decoder thread before it reads the next packet
+    player->scrubbing = scrubbing;
+}
+
+bool Kit_IsPlayerScrubbing(const Kit_Player *player) {
+    assert(player != NULL);
+
+    return player->scrubbing;
+}
+
+int Kit_SetPlayerDvrWindow(Kit_Player *player, double seconds, int megabytes) {
+    assert(player != NULL);
+
+    if(seconds < 0 || megabytes < 0) {
+        Kit_SetError("Packet window limits can't be negative");
+        return 1;
+    }
+    if(SDL_LockMutex(player->cmutex) != 0) {
+        Kit_SetError("Unable to lock control queue mutex");
+        return 1;
+    }
+    player->dvr_seconds = seconds;
+    player->dvr_megabytes = megabytes;
+    player->dvr_changed = true;
+    SDL_UnlockMutex(player->cmutex);
+    return 0;
+}
+
+int Kit_SetPlayerLoopSegment(Kit_Player *player, double start, double end) {
+    assert(player != NULL);
+
+    if(start < 0 || end <= start) {
+        Kit_SetError("Invalid loop segment %f - %f", start, end);
+        return 1;
+    }
+    if(SDL_LockMutex(player->cmutex) != 0) {
+        Kit_SetError("Unable to lock control queue mutex");
+        return 1;
+    }
+
+    // Pending seeks would only be overridden by the jump to the loop start
+    Kit_ClearBuffer((Kit_Buffer*)player->cbuffer);
+    player->loop_req_start = start;
+    player->loop_req_end = end;
+    player->loop_changed = true;
+    SDL_UnlockMutex(player->cmutex);
+    return 0;
+}
+
+int Kit_ClearPlayerLoopSegment(Kit_Player *player) {
+    assert(player != NULL);
+
+    if(SDL_LockMutex(player->cmutex) != 0) {
+        Kit_SetError("Unable to lock control queue mutex");
+        return 1;
+    }
+    player->loop_req_start = 0;
+    player->loop_req_end = 0;
+    player->loop_changed = true;
+    SDL_UnlockMutex(player->cmutex);
+    return 0;
+}
+
+int Kit_SetPlayerLoopCacheSize(Kit_Player *player, int megabytes) {
+    assert(player != NULL);
+
+    if(megabytes < 0) {
+        Kit_SetError("Loop cache size can't be negative");
+        return 1;
+    }
+    if(SDL_LockMutex(player->cmutex) != 0) {
+        Kit_SetError("Unable to lock control queue mutex");
+        return 1;
+    }
+    player->loop_cache_megabytes = megabytes;
+    SDL_UnlockMutex(player->cmutex);
+    return 0;
+}
+
+bool Kit_IsPlayerLoopCached(const Kit_Player *player) {
+    assert(player != NULL);
+
+    bool cached = false;
+    if(SDL_LockMutex(player->cmutex) == 0) {
+        const Kit_LoopCache *cache = (const Kit_LoopCache*)player->loop_cache;
+        cached = (!player->loop_changed && player->loop_end > 0 && cache != NULL && cache->complete);
+        SDL_UnlockMutex(player->cmutex);
+    }
+    return cached;
+}
+
+int Kit_QueuePlayerSource(Kit_Player *player, const Kit_Source *src) {
+    assert(player != NULL);
+
+    // Output formats are fixed, so the queued source needs the same kinds of streams
+    Kit_QueuedItem *item = NULL;
+    if(src != NULL) {
+        if(player->aformat.is_enabled && src->astream_idx < 0) {
+            Kit_SetError("Queued source has no audio stream");
+            return 1;
+        }
+        if(player->vformat.is_enabled && src->vstream_idx < 0) {
+            Kit_SetError("Queued source has no video stream");
+            return 1;
+        }
+        item = calloc(1, sizeof(Kit_QueuedItem));
+        if(item == NULL) {
+            Kit_SetError("Unable to allocate queued source");
+            return 1;
+        }
+        item->src = src;
+        item->preread = calloc(1, sizeof(Kit_Preread));
+        if(item->preread == NULL) {
+            Kit_SetError("Unable to allocate queued source");
+            goto exit_0;
+        }
+        if(_InitCodecs(src,
+                       player->aformat.is_enabled ? (void**)&item->acodec_ctx : NULL,
+                       player->vformat.is_enabled ? (void**)&item->vcodec_ctx : NULL,
+                       NULL) != 0) {
+            goto exit_0;
+        }
+        if(item->acodec_ctx != NULL) {
+            item->swr = _CreateResampler(player, item->acodec_ctx);
+            if(item->swr == NULL) {
+                goto exit_0;
+            }
+        }
+        if(item->vcodec_ctx != NULL) {
+            item->sws = _CreateScaler(player, item->vcodec_ctx);
+            if(item->sws == NULL) {
+                goto exit_0;
+            }
+        }
+    }
+
+    // Replaces any source queued earlier
+    if(SDL_LockMutex(player->cmutex) != 0) {
+        Kit_SetError("Unable to lock control queue mutex");
+        goto exit_0;
+    }
+    Kit_QueuedItem *old = (Kit_QueuedItem*)player->next_item;
+    player->next_item = item;
+    SDL_UnlockMutex(player->cmutex);
+    _FreeQueuedItem(old);
     return 0;
+
+exit_0:
+    _FreeQueuedItem(item);
+    return 1;
+}
+
+void Kit_SetPlayerLooping(Kit_Player *player, bool looping) {
+    assert(player != NULL);
+
+    player->looping = looping;
+}
+
+bool Kit_IsPlayerLooping(const Kit_Player *player) {
+    assert(player != NULL);
+
+    return player->looping;
 }
 
 double Kit_GetPlayerDuration(const Kit_Player *player) {
     assert(player != NULL);
 
-    AVFormatContext *fmt_ctx = (AVFormatContext *)player->src->format_ctx;
-    return (fmt_ctx->duration / AV_TIME_BASE);
+    // Source is swapped by the decoder thread when a queued one takes over
+    double duration = 0;
+    if(SDL_LockMutex(player->cmutex) == 0) {
+        AVFormatContext *fmt_ctx = (AVFormatContext *)player->src->format_ctx;
+        duration = (fmt_ctx->duration / AV_TIME_BASE);
+        SDL_UnlockMutex(player->cmutex);
+    }
+    return duration;
 }
 
 double Kit_GetPlayerPosition(const Kit_Player *player) {
     assert(player != NULL);
 
-    return player->vclock_pos;
+    // Stream clock keeps running across sources and loop passes; map it back into the source
+    // on screen, and then into the loop
+    double pos = player->vclock_pos;
+    pos -= (pos >= player->item_base) ? player->item_offset : player->prev_item_offset;
+    if(player->loop_end > player->loop_start && pos >= player->loop_end) {
+        pos = player->loop_start + fmod(pos - player->loop_start, player->loop_end - player->loop_start);
+    }
+    return pos;
 }
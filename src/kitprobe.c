@@ -0,0 +1,143 @@
+#include "kitchensink/kitsource.h"
+#include "kitchensink/kiterror.h"
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+
+#include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_atomic.h>
+#include <SDL2/SDL_cpuinfo.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+// Probing only reads the container headers, unless the format has none.
+#define KIT_PROBE_PROBESIZE 65536
+#define KIT_PROBE_ANALYZEDURATION 500000
+
+typedef struct Kit_ProbeJob {
+    const char **paths;
+    Kit_ProbeResult *results;
+    int count;
+    SDL_atomic_t next; ///< Index of the next path to be picked up by a worker
+} Kit_ProbeJob;
+
+static Kit_StreamType _GetStreamType(enum AVMediaType type) {
+    switch(type) {
+        case AVMEDIA_TYPE_DATA: return KIT_STREAMTYPE_DATA;
+        case AVMEDIA_TYPE_VIDEO: return KIT_STREAMTYPE_VIDEO;
+        case AVMEDIA_TYPE_AUDIO: return KIT_STREAMTYPE_AUDIO;
+        case AVMEDIA_TYPE_SUBTITLE: return KIT_STREAMTYPE_SUBTITLE;
+        case AVMEDIA_TYPE_ATTACHMENT: return KIT_STREAMTYPE_ATTACHMENT;
+        default:
+            return KIT_STREAMTYPE_UNKNOWN;
+    }
+}
+
+static void _ProbeFile(const char *path, Kit_ProbeResult *result) {
+    AVFormatContext *format_ctx = NULL;
+    AVDictionary *dict = NULL;
+
+    memset(result, 0, sizeof(Kit_ProbeResult));
+    result->error = 1;
+    result->duration = -1;
+
+    av_dict_set_int(&dict, "probesize", KIT_PROBE_PROBESIZE, 0);
+    av_dict_set_int(&dict, "analyzeduration", KIT_PROBE_ANALYZEDURATION, 0);
+    // Workers run in parallel, so failures are kept with the result instead of Kit_SetError
+    char reason[128];
+    int ret = avformat_open_input(&format_ctx, path, NULL, &dict);
+    if(ret < 0) {
+        av_strerror(ret, reason, sizeof(reason));
+        snprintf(result->error_message, KIT_PROBEERRORSIZE, "Unable to open %s: %s", path, reason);
+        goto exit_0;
+    }
+
+    // Most containers describe their streams in the header. Headerless ones (eg. MPEG-TS)
+    // need a short look at the packets to find them at all.
+    if(format_ctx->ctx_flags & AVFMTCTX_NOHEADER) {
+        ret = avformat_find_stream_info(format_ctx, NULL);
+        if(ret < 0) {
+            av_strerror(ret, reason, sizeof(reason));
+            snprintf(result->error_message, KIT_PROBEERRORSIZE, "Unable to fetch stream information: %s", reason);
+            goto exit_1;
+        }
+    }
+
+    if(format_ctx->duration != AV_NOPTS_VALUE) {
+        result->duration = format_ctx->duration / (double)AV_TIME_BASE;
+    }
+    snprintf(result->format_name, KIT_CODECNAMESIZE, "%s", format_ctx->iformat->name);
+    result->stream_count = format_ctx->nb_streams;
+    for(unsigned int i = 0; i < format_ctx->nb_streams && i < KIT_PROBEMAXSTREAMS; i++) {
+        AVCodecContext *codec_ctx = format_ctx->streams[i]->codec;
+        Kit_ProbeStreamInfo *info = &result->streams[i];
+        info->index = i;
+        info->type = _GetStreamType(codec_ctx->codec_type);
+        snprintf(info->codec_name, KIT_CODECNAMESIZE, "%s", avcodec_get_name(codec_ctx->codec_id));
+        if(info->type == KIT_STREAMTYPE_VIDEO) {
+            info->width = codec_ctx->width;
+            info->height = codec_ctx->height;
+        } else if(info->type == KIT_STREAMTYPE_AUDIO) {
+            info->samplerate = codec_ctx->sample_rate;
+            info->channels = codec_ctx->channels;
+        }
+    }
+    result->error = 0;
+
+exit_1:
+    avformat_close_input(&format_ctx);
+exit_0:
+    av_dict_free(&dict);
+}
+
+static int _ProbeThread(void *ptr) {
+    Kit_ProbeJob *job = ptr;
+    int index;
+    while((index = SDL_AtomicAdd(&job->next, 1)) < job->count) {
+        _ProbeFile(job->paths[index], &job->results[index]);
+    }
+    return 0;
+}
+
+int Kit_ProbeFiles(const char **paths, int count, Kit_ProbeResult *results, int threads) {
+    assert(paths != NULL);
+    assert(results != NULL);
+
+    Kit_ProbeJob job;
+    job.paths = paths;
+    job.results = results;
+    job.count = count;
+    SDL_AtomicSet(&job.next, 0);
+
+    // One worker per core by default. The calling thread counts as one of them.
+    if(threads <= 0) {
+        threads = SDL_GetCPUCount();
+    }
+    if(threads > count) {
+        threads = count;
+    }
+    if(threads <= 1) {
+        _ProbeThread(&job);
+        return 0;
+    }
+
+    SDL_Thread **workers = calloc(threads - 1, sizeof(SDL_Thread*));
+    if(workers == NULL) {
+        Kit_SetError("Unable to allocate probe workers");
+        return 1;
+    }
+    for(int i = 0; i < threads - 1; i++) {
+        workers[i] = SDL_CreateThread(_ProbeThread, "Kit Probe Thread", &job);
+    }
+    _ProbeThread(&job);
+    for(int i = 0; i < threads - 1; i++) {
+        if(workers[i] != NULL) {
+            SDL_WaitThread(workers[i], NULL);
+        }
+    }
+    free(workers);
+    return 0;
+}
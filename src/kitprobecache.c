@@ -0,0 +1,321 @@
+#include "kitchensink/internal/kitprobecache.h"
+
+#include <libavcodec/avcodec.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+// Cache files are only ever read back by the machine that wrote them, so values are stored in native byte order.
+#define KIT_PROBECACHE_MAGIC 0x3143504B // "KPC1"
+#define KIT_PROBECACHE_PATHSIZE 4096
+#define KIT_PROBECACHE_MAX_EXTRADATA (1 << 20)
+
+typedef struct Kit_ProbeCacheKey {
+    uint64_t hash; ///< FNV-1a hash of path, size and mtime; used as the cache file name
+    int64_t size; ///< Source file size in bytes
+    int64_t mtime; ///< Source file modification time
+} Kit_ProbeCacheKey;
+
+static uint64_t _HashBytes(uint64_t hash, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for(size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+static int _GetCacheKey(const char *path, Kit_ProbeCacheKey *key) {
+    struct stat st;
+    if(stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return 1;
+    }
+    key->size = st.st_size;
+    key->mtime = st.st_mtime;
+    key->hash = 0xCBF29CE484222325ULL;
+    key->hash = _HashBytes(key->hash, path, strlen(path));
+    key->hash = _HashBytes(key->hash, &key->size, sizeof(key->size));
+    key->hash = _HashBytes(key->hash, &key->mtime, sizeof(key->mtime));
+    return 0;
+}
+
+static int _GetCachePath(char *out, const char *cache_dir, const Kit_ProbeCacheKey *key, const char *ext) {
+    int len = snprintf(out, KIT_PROBECACHE_PATHSIZE, "%s/%016llx.%s",
+                       cache_dir, (unsigned long long)key->hash, ext);
+    return (len < 0 || len >= KIT_PROBECACHE_PATHSIZE);
+}
+
+static int _WriteInt(FILE *fp, int64_t value) {
+    return fwrite(&value, sizeof(int64_t), 1, fp) != 1;
+}
+
+static int _ReadInt(FILE *fp, int64_t *value) {
+    return fread(value, sizeof(int64_t), 1, fp) != 1;
+}
+
+static int _WriteRational(FILE *fp, AVRational value) {
+    return _WriteInt(fp, value.num) | _WriteInt(fp, value.den);
+}
+
+static int _ReadRational(FILE *fp, AVRational *value) {
+    int64_t num = 0, den = 0;
+    int err = _ReadInt(fp, &num) | _ReadInt(fp, &den);
+    value->num = num;
+    value->den = den;
+    return err;
+}
+
+static int _WriteParameters(FILE *fp, const AVCodecParameters *par) {
+    int err = 0;
+    err |= _WriteInt(fp, par->codec_type);
+    err |= _WriteInt(fp, par->codec_id);
+    err |= _WriteInt(fp, par->codec_tag);
+    err |= _WriteInt(fp, par->format);
+    err |= _WriteInt(fp, par->bit_rate);
+    err |= _WriteInt(fp, par->bits_per_coded_sample);
+    err |= _WriteInt(fp, par->bits_per_raw_sample);
+    err |= _WriteInt(fp, par->profile);
+    err |= _WriteInt(fp, par->level);
+    err |= _WriteInt(fp, par->width);
+    err |= _WriteInt(fp, par->height);
+    err |= _WriteRational(fp, par->sample_aspect_ratio);
+    err |= _WriteInt(fp, par->field_order);
+    err |= _WriteInt(fp, par->color_range);
+    err |= _WriteInt(fp, par->color_primaries);
+    err |= _WriteInt(fp, par->color_trc);
+    err |= _WriteInt(fp, par->color_space);
+    err |= _WriteInt(fp, par->chroma_location);
+    err |= _WriteInt(fp, par->video_delay);
+    err |= _WriteInt(fp, (int64_t)par->channel_layout);
+    err |= _WriteInt(fp, par->channels);
+    err |= _WriteInt(fp, par->sample_rate);
+    err |= _WriteInt(fp, par->block_align);
+    err |= _WriteInt(fp, par->frame_size);
+    err |= _WriteInt(fp, par->initial_padding);
+    err |= _WriteInt(fp, par->trailing_padding);
+    err |= _WriteInt(fp, par->seek_preroll);
+    err |= _WriteInt(fp, par->extradata_size);
+    if(par->extradata_size > 0) {
+        err |= fwrite(par->extradata, par->extradata_size, 1, fp) != 1;
+    }
+    return err;
+}
+
+static int _ReadParameters(FILE *fp, AVCodecParameters *par) {
+    int64_t v[28];
+    for(int i = 0; i < 28; i++) {
+        if(_ReadInt(fp, &v[i])) {
+            return 1;
+        }
+    }
+    par->codec_type = v[0];
+    par->codec_id = v[1];
+    par->codec_tag = v[2];
+    par->format = v[3];
+    par->bit_rate = v[4];
+    par->bits_per_coded_sample = v[5];
+    par->bits_per_raw_sample = v[6];
+    par->profile = v[7];
+    par->level = v[8];
+    par->width = v[9];
+    par->height = v[10];
+    par->sample_aspect_ratio.num = v[11];
+    par->sample_aspect_ratio.den = v[12];
+    par->field_order = v[13];
+    par->color_range = v[14];
+    par->color_primaries = v[15];
+    par->color_trc = v[16];
+    par->color_space = v[17];
+    par->chroma_location = v[18];
+    par->video_delay = v[19];
+    par->channel_layout = (uint64_t)v[20];
+    par->channels = v[21];
+    par->sample_rate = v[22];
+    par->block_align = v[23];
+    par->frame_size = v[24];
+    par->initial_padding = v[25];
+    par->trailing_padding = v[26];
+    par->seek_preroll = v[27];
+
+    if(_ReadInt(fp, &v[0]) || v[0] < 0 || v[0] > KIT_PROBECACHE_MAX_EXTRADATA) {
+        return 1;
+    }
+    av_freep(&par->extradata);
+    par->extradata_size = 0;
+    if(v[0] > 0) {
+        par->extradata = av_mallocz(v[0] + AV_INPUT_BUFFER_PADDING_SIZE);
+        if(par->extradata == NULL) {
+            return 1;
+        }
+        par->extradata_size = v[0];
+        if(fread(par->extradata, par->extradata_size, 1, fp) != 1) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int Kit_LoadProbeCache(AVFormatContext *format_ctx, const char *cache_dir, const char *path) {
+    char cache_path[KIT_PROBECACHE_PATHSIZE];
+    char cached_name[KIT_PROBECACHE_PATHSIZE];
+    AVCodecParameters **pars = NULL;
+    AVRational *rates = NULL;
+    int64_t *times = NULL;
+    Kit_ProbeCacheKey key;
+    int64_t v[6];
+    int ret = 1;
+
+    if(_GetCacheKey(path, &key) || _GetCachePath(cache_path, cache_dir, &key, "kpc")) {
+        return 1;
+    }
+    FILE *fp = fopen(cache_path, "rb");
+    if(fp == NULL) {
+        return 1;
+    }
+
+    // Header: magic, file size, mtime, path. Any mismatch means the entry is stale or a hash collision.
+    size_t path_len = strlen(path);
+    for(int i = 0; i < 4; i++) {
+        if(_ReadInt(fp, &v[i])) {
+            goto exit_0;
+        }
+    }
+    if(v[0] != KIT_PROBECACHE_MAGIC || v[1] != key.size || v[2] != key.mtime || v[3] != (int64_t)path_len) {
+        goto exit_0;
+    }
+    if(path_len >= KIT_PROBECACHE_PATHSIZE || fread(cached_name, 1, path_len, fp) != path_len) {
+        goto exit_0;
+    }
+    if(memcmp(cached_name, path, path_len) != 0) {
+        goto exit_0;
+    }
+
+    // Container level information. Stream count must match what the demuxer found from the headers.
+    for(int i = 0; i < 4; i++) {
+        if(_ReadInt(fp, &v[i])) {
+            goto exit_0;
+        }
+    }
+    if(v[3] != format_ctx->nb_streams) {
+        goto exit_0;
+    }
+    int64_t duration = v[0];
+    int64_t start_time = v[1];
+    int64_t bit_rate = v[2];
+
+    // Read everything before touching the format context, so that a truncated file changes nothing.
+    pars = calloc(format_ctx->nb_streams, sizeof(AVCodecParameters*));
+    if(pars == NULL) {
+        goto exit_0;
+    }
+    rates = calloc(format_ctx->nb_streams * 2, sizeof(AVRational));
+    times = calloc(format_ctx->nb_streams * 2, sizeof(int64_t));
+    if(rates == NULL || times == NULL) {
+        goto exit_1;
+    }
+    for(unsigned int i = 0; i < format_ctx->nb_streams; i++) {
+        AVStream *stream = format_ctx->streams[i];
+        if(_ReadRational(fp, &rates[i * 2])
+            || _ReadRational(fp, &rates[i * 2 + 1])
+            || _ReadInt(fp, &times[i * 2])
+            || _ReadInt(fp, &times[i * 2 + 1])) {
+            goto exit_1;
+        }
+        pars[i] = avcodec_parameters_alloc();
+        if(pars[i] == NULL || _ReadParameters(fp, pars[i])) {
+            goto exit_1;
+        }
+        if(pars[i]->codec_type != stream->codec->codec_type) {
+            goto exit_1;
+        }
+        if(stream->codec->codec_id != AV_CODEC_ID_NONE && pars[i]->codec_id != stream->codec->codec_id) {
+            goto exit_1;
+        }
+    }
+
+    // Entry is valid; restore parameters as if avformat_find_stream_info had run.
+    for(unsigned int i = 0; i < format_ctx->nb_streams; i++) {
+        AVStream *stream = format_ctx->streams[i];
+        if(avcodec_parameters_copy(stream->codecpar, pars[i]) < 0
+            || avcodec_parameters_to_context(stream->codec, pars[i]) < 0) {
+            goto exit_1;
+        }
+        stream->avg_frame_rate = rates[i * 2];
+        stream->r_frame_rate = rates[i * 2 + 1];
+        stream->start_time = times[i * 2];
+        stream->duration = times[i * 2 + 1];
+    }
+    format_ctx->duration = duration;
+    format_ctx->start_time = start_time;
+    format_ctx->bit_rate = bit_rate;
+    ret = 0;
+
+exit_1:
+    for(unsigned int i = 0; i < format_ctx->nb_streams; i++) {
+        avcodec_parameters_free(&pars[i]);
+    }
+    free(pars);
+    free(rates);
+    free(times);
+exit_0:
+    fclose(fp);
+    return ret;
+}
+
+int Kit_SaveProbeCache(const AVFormatContext *format_ctx, const char *cache_dir, const char *path) {
+    char cache_path[KIT_PROBECACHE_PATHSIZE];
+    char temp_path[KIT_PROBECACHE_PATHSIZE];
+    Kit_ProbeCacheKey key;
+    int err = 0;
+
+    if(_GetCacheKey(path, &key)
+        || _GetCachePath(cache_path, cache_dir, &key, "kpc")
+        || _GetCachePath(temp_path, cache_dir, &key, "tmp")) {
+        return 1;
+    }
+    AVCodecParameters *par = avcodec_parameters_alloc();
+    if(par == NULL) {
+        return 1;
+    }
+    FILE *fp = fopen(temp_path, "wb");
+    if(fp == NULL) {
+        avcodec_parameters_free(&par);
+        return 1;
+    }
+
+    size_t path_len = strlen(path);
+    err |= _WriteInt(fp, KIT_PROBECACHE_MAGIC);
+    err |= _WriteInt(fp, key.size);
+    err |= _WriteInt(fp, key.mtime);
+    err |= _WriteInt(fp, path_len);
+    err |= fwrite(path, 1, path_len, fp) != path_len;
+    err |= _WriteInt(fp, format_ctx->duration);
+    err |= _WriteInt(fp, format_ctx->start_time);
+    err |= _WriteInt(fp, format_ctx->bit_rate);
+    err |= _WriteInt(fp, format_ctx->nb_streams);
+    for(unsigned int i = 0; i < format_ctx->nb_streams && !err; i++) {
+        const AVStream *stream = format_ctx->streams[i];
+        err |= _WriteRational(fp, stream->avg_frame_rate);
+        err |= _WriteRational(fp, stream->r_frame_rate);
+        err |= _WriteInt(fp, stream->start_time);
+        err |= _WriteInt(fp, stream->duration);
+        // The codec context is what players copy from, so cache that rather than codecpar.
+        err |= avcodec_parameters_from_context(par, stream->codec) < 0;
+        err |= _WriteParameters(fp, par);
+    }
+    err |= fclose(fp) != 0;
+    avcodec_parameters_free(&par);
+
+    // Swap the finished file in place, so that readers never see a partial entry.
+    if(!err) {
+        remove(cache_path);
+        err = rename(temp_path, cache_path) != 0;
+    }
+    if(err) {
+        remove(temp_path);
+    }
+    return err;
+}
@@ -0,0 +1,349 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "kitchensink/kitsource.h"
+#include "kitchensink/kiterror.h"
+#include "kitchensink/internal/kitsourceio.h"
+
+#include <libavformat/avformat.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef KIT_HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+// Number of blocks kept in flight ahead of the read position, and the size of each
+#define KIT_QUEUED_DEPTH 4
+#define KIT_QUEUED_BLOCKSIZE (256 * 1024)
+
+typedef struct Kit_QueuedBlock {
+    unsigned char *data; ///< Block buffer, KIT_QUEUED_BLOCKSIZE bytes
+    int64_t offset; ///< File offset of the block
+    int len; ///< Bytes read once complete, or negative errno. Short only at end of file.
+    bool used; ///< Block is assigned to offset
+    bool inflight; ///< Read has been submitted but not completed yet
+} Kit_QueuedBlock;
+
+typedef struct Kit_QueuedFile {
+    int fd;
+    int64_t size; ///< File size in bytes
+    int64_t pos; ///< Demuxer read position
+    int64_t next_offset; ///< Offset of the next block to request
+    int depth; ///< Blocks in flight at most; 1 when reading synchronously
+    Kit_QueuedBlock blocks[KIT_QUEUED_DEPTH];
+#ifdef KIT_HAVE_LIBURING
+    struct io_uring ring;
+    bool use_uring; ///< Ring is set up and working; otherwise fall back to pread
+#endif
+} Kit_QueuedFile;
+
+// Reads may complete short of what was asked even in the middle of the file. Fetch the
+// rest synchronously, so that a block always covers its whole range up to the end of file.
+static void _ReadRemainder(Kit_QueuedFile *qf, Kit_QueuedBlock *block) {
+    int64_t want = qf->size - block->offset;
+    if(want > KIT_QUEUED_BLOCKSIZE) {
+        want = KIT_QUEUED_BLOCKSIZE;
+    }
+    while(block->len >= 0 && block->len < want) {
+        ssize_t ret = pread(qf->fd, block->data + block->len, want - block->len, block->offset + block->len);
+        if(ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if(ret < 0) {
+            block->len = -errno;
+            break;
+        }
+        if(ret == 0) {
+            // File was truncated after opening
+            break;
+        }
+        block->len += ret;
+    }
+}
+
+static void _ReadBlockSync(Kit_QueuedFile *qf, Kit_QueuedBlock *block) {
+    block->len = 0;
+    _ReadRemainder(qf, block);
+    block->inflight = false;
+}
+
+#ifdef KIT_HAVE_LIBURING
+// Gives up on the ring for good, and redoes whatever was still outstanding with pread. Reads
+// that were in flight may still land in their buffers after the ring is gone, so those blocks
+// get new buffers; the old ones are left to the kernel and never reused.
+static void _StopUring(Kit_QueuedFile *qf) {
+    io_uring_queue_exit(&qf->ring);
+    qf->use_uring = false;
+    qf->depth = 1;
+    for(int i = 0; i < KIT_QUEUED_DEPTH; i++) {
+        Kit_QueuedBlock *block = &qf->blocks[i];
+        if(!block->inflight) {
+            continue;
+        }
+        unsigned char *data = malloc(KIT_QUEUED_BLOCKSIZE);
+        if(data == NULL) {
+            block->len = -ENOMEM;
+            block->inflight = false;
+            continue;
+        }
+        block->data = data;
+        _ReadBlockSync(qf, block);
+    }
+}
+
+static void _WaitCompletion(Kit_QueuedFile *qf) {
+    struct io_uring_cqe *cqe;
+    int ret;
+    do {
+        ret = io_uring_wait_cqe(&qf->ring, &cqe);
+    } while(ret == -EINTR);
+    if(ret < 0) {
+        _StopUring(qf);
+        return;
+    }
+    Kit_QueuedBlock *block = io_uring_cqe_get_data(cqe);
+    block->len = cqe->res;
+    block->inflight = false;
+    io_uring_cqe_seen(&qf->ring, cqe);
+
+    // The kernel can't do this kind of read after all. Nothing was read, so the block is
+    // filled in by pread when waited on, and everything else goes through pread from now on.
+    if(block->len == -EINVAL || block->len == -EOPNOTSUPP) {
+        block->len = 0;
+        _StopUring(qf);
+    }
+}
+#endif
+
+static void _WaitInflight(Kit_QueuedFile *qf, Kit_QueuedBlock *block) {
+#ifdef KIT_HAVE_LIBURING
+    while(block->inflight) {
+        _WaitCompletion(qf);
+    }
+#else
+    (void)qf;
+    (void)block;
+#endif
+}
+
+// Waits for the block, and tops up a short completion so that it is ready for reading
+static void _WaitBlock(Kit_QueuedFile *qf, Kit_QueuedBlock *block) {
+    _WaitInflight(qf, block);
+    _ReadRemainder(qf, block);
+}
+
+static void _DrainBlocks(Kit_QueuedFile *qf) {
+    for(int i = 0; i < KIT_QUEUED_DEPTH; i++) {
+        _WaitInflight(qf, &qf->blocks[i]);
+    }
+}
+
+static void _FillBlocks(Kit_QueuedFile *qf) {
+    int submitted = 0;
+    int in_use = 0;
+
+    // Blocks entirely behind the reader are free for reuse
+    for(int i = 0; i < KIT_QUEUED_DEPTH; i++) {
+        Kit_QueuedBlock *block = &qf->blocks[i];
+        if(block->used && !block->inflight && block->offset + KIT_QUEUED_BLOCKSIZE <= qf->pos) {
+            block->used = false;
+        }
+        if(block->used) {
+            in_use++;
+        }
+    }
+
+    for(int i = 0; i < KIT_QUEUED_DEPTH && in_use < qf->depth; i++) {
+        Kit_QueuedBlock *block = &qf->blocks[i];
+        if(block->used) {
+            continue;
+        }
+        if(qf->next_offset >= qf->size) {
+            break;
+        }
+        block->offset = qf->next_offset;
+        block->used = true;
+        block->inflight = true;
+        qf->next_offset += KIT_QUEUED_BLOCKSIZE;
+        in_use++;
+#ifdef KIT_HAVE_LIBURING
+        if(qf->use_uring) {
+            struct io_uring_sqe *sqe = io_uring_get_sqe(&qf->ring);
+            if(sqe != NULL) {
+                io_uring_prep_read(sqe, qf->fd, block->data, KIT_QUEUED_BLOCKSIZE, block->offset);
+                io_uring_sqe_set_data(sqe, block);
+                submitted++;
+                continue;
+            }
+        }
+#endif
+        _ReadBlockSync(qf, block);
+    }
+
+#ifdef KIT_HAVE_LIBURING
+    // Reads that didn't make it to the kernel would never complete, and waiting on them would hang
+    if(submitted > 0 && io_uring_submit(&qf->ring) < submitted) {
+        _StopUring(qf);
+    }
+#endif
+    (void)submitted;
+}
+
+// Blocks are matched on the range they were requested for. Waiting on a block fills that whole
+// range, so a short completion never ends up looking like the end of the file.
+static Kit_QueuedBlock* _FindBlock(Kit_QueuedFile *qf, int64_t pos) {
+    for(int i = 0; i < KIT_QUEUED_DEPTH; i++) {
+        Kit_QueuedBlock *block = &qf->blocks[i];
+        if(block->used && pos >= block->offset && pos < block->offset + KIT_QUEUED_BLOCKSIZE) {
+            return block;
+        }
+    }
+    return NULL;
+}
+
+static int _QueuedRead(void *opaque, uint8_t *buf, int size) {
+    Kit_QueuedFile *qf = opaque;
+    if(qf->pos >= qf->size) {
+        return AVERROR_EOF;
+    }
+
+    // A miss means the demuxer jumped away from the queued range; restart the queue at its position.
+    Kit_QueuedBlock *block = _FindBlock(qf, qf->pos);
+    if(block == NULL) {
+        _DrainBlocks(qf);
+        for(int i = 0; i < KIT_QUEUED_DEPTH; i++) {
+            qf->blocks[i].used = false;
+        }
+        qf->next_offset = qf->pos - (qf->pos % KIT_QUEUED_BLOCKSIZE);
+        _FillBlocks(qf);
+        block = _FindBlock(qf, qf->pos);
+        if(block == NULL) {
+            return AVERROR(EIO);
+        }
+    }
+
+    _WaitBlock(qf, block);
+    if(block->len < 0) {
+        int err = -block->len;
+        block->used = false;
+        return AVERROR(err);
+    }
+    // Only possible if the file was truncated while open; end of file was handled above
+    int64_t avail = block->offset + block->len - qf->pos;
+    if(avail <= 0) {
+        block->used = false;
+        return AVERROR(EIO);
+    }
+    if(size > avail) {
+        size = avail;
+    }
+    memcpy(buf, block->data + (qf->pos - block->offset), size);
+    qf->pos += size;
+
+    // Keep the queue topped up as blocks get consumed
+    _FillBlocks(qf);
+    return size;
+}
+
+static int64_t _QueuedSeek(void *opaque, int64_t offset, int whence) {
+    Kit_QueuedFile *qf = opaque;
+    int64_t pos;
+    switch(whence & ~AVSEEK_FORCE) {
+        case AVSEEK_SIZE: return qf->size;
+        case SEEK_SET: pos = offset; break;
+        case SEEK_CUR: pos = qf->pos + offset; break;
+        case SEEK_END: pos = qf->size + offset; break;
+        default:
+            return AVERROR(EINVAL);
+    }
+    if(pos < 0 || pos > qf->size) {
+        return AVERROR(EINVAL);
+    }
+    qf->pos = pos;
+    return pos;
+}
+
+static void _QueuedClose(void *opaque) {
+    Kit_QueuedFile *qf = opaque;
+
+    // The kernel may still be writing into the block buffers
+    _DrainBlocks(qf);
+#ifdef KIT_HAVE_LIBURING
+    if(qf->use_uring) {
+        io_uring_queue_exit(&qf->ring);
+    }
+#endif
+    for(int i = 0; i < KIT_QUEUED_DEPTH; i++) {
+        free(qf->blocks[i].data);
+    }
+    close(qf->fd);
+    free(qf);
+}
+
+Kit_Source* Kit_OpenQueuedFileSource(const char *path, const Kit_SourceOptions *opts,
+                                     const AVIOInterruptCB *interrupt) {
+    assert(path != NULL);
+    assert(opts != NULL);
+    struct stat st;
+
+    Kit_QueuedFile *qf = calloc(1, sizeof(Kit_QueuedFile));
+    if(qf == NULL) {
+        Kit_SetError("Unable to allocate queued file reader");
+        return NULL;
+    }
+    qf->fd = open(path, O_RDONLY);
+    if(qf->fd < 0) {
+        Kit_SetError("Unable to open file %s", path);
+        free(qf);
+        return NULL;
+    }
+    if(fstat(qf->fd, &st) != 0) {
+        Kit_SetError("Unable to read file size of %s", path);
+        goto exit_0;
+    }
+    qf->size = st.st_size;
+    for(int i = 0; i < KIT_QUEUED_DEPTH; i++) {
+        qf->blocks[i].data = malloc(KIT_QUEUED_BLOCKSIZE);
+        if(qf->blocks[i].data == NULL) {
+            Kit_SetError("Unable to allocate queued file blocks");
+            goto exit_0;
+        }
+    }
+
+    // Without io_uring (or on kernels that refuse it), read one block at a time with pread
+    qf->depth = 1;
+#ifdef KIT_HAVE_LIBURING
+    if(io_uring_queue_init(KIT_QUEUED_DEPTH, &qf->ring, 0) == 0) {
+        // Kernels before 5.6 set up rings fine, but fail every plain read on them
+        struct io_uring_probe *probe = io_uring_get_probe_ring(&qf->ring);
+        if(probe != NULL && io_uring_opcode_supported(probe, IORING_OP_READ)) {
+            qf->use_uring = true;
+            qf->depth = KIT_QUEUED_DEPTH;
+        } else {
+            io_uring_queue_exit(&qf->ring);
+        }
+        if(probe != NULL) {
+            io_uring_free_probe(probe);
+        }
+    }
+#endif
+
+    return Kit_OpenCustomSource(path, _QueuedRead, _QueuedSeek, qf, _QueuedClose, KIT_AVIO_BUFFERSIZE, opts, interrupt);
+
+exit_0:
+    _QueuedClose(qf);
+    return NULL;
+}
+
+#endif
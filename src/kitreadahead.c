@@ -0,0 +1,274 @@
+#include "kitchensink/kitsource.h"
+#include "kitchensink/kiterror.h"
+#include "kitchensink/internal/kitsourceio.h"
+
+#include <libavformat/avformat.h>
+
+#include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_mutex.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+// Largest single read issued against the underlying IO context
+#define KIT_READAHEAD_CHUNK 65536
+
+// Part of the cache kept behind the read position for short backward seeks
+#define KIT_READAHEAD_BACK_DIVISOR 4
+
+/**
+ * Bytes [win_start, win_end) of the stream are held in a ring buffer of `capacity` bytes,
+ * at offset (byte position % capacity). The background thread only appends at win_end and
+ * drops from win_start; the demuxer thread only moves pos, or requests a seek out of the window.
+ */
+typedef struct Kit_ReadAhead {
+    AVIOContext *inner; ///< FFmpeg: IO context doing the actual reading
+    unsigned char *ring; ///< Cached bytes
+    int64_t capacity; ///< Size of the ring in bytes
+    int64_t back_keep; ///< Bytes kept behind pos when the ring is full
+    int64_t size; ///< Stream size, or negative if unknown
+    int64_t win_start; ///< First cached byte position
+    int64_t win_end; ///< One past the last cached byte position
+    int64_t pos; ///< Demuxer read position
+    unsigned int generation; ///< Bumped on every seek outside the window
+    bool seeking; ///< Window is being moved to pos; reads must wait
+    bool eof; ///< Underlying IO hit end of stream at win_end
+    bool error; ///< Underlying IO failed at win_end
+    bool quit; ///< Source is closing
+    AVIOInterruptCB interrupt; ///< Caller's interrupt callback while opening, protected by lock
+    SDL_mutex *lock;
+    SDL_cond *data_cond; ///< Signalled when data arrives or a seek completes
+    SDL_cond *fill_cond; ///< Signalled when the reader consumes data or requests a seek
+    SDL_Thread *thread;
+} Kit_ReadAhead;
+
+static int _ReadAheadInterrupt(void *opaque) {
+    Kit_ReadAhead *ra = opaque;
+    SDL_LockMutex(ra->lock);
+    int ret = ra->quit || (ra->interrupt.callback != NULL && ra->interrupt.callback(ra->interrupt.opaque));
+    SDL_UnlockMutex(ra->lock);
+    return ret;
+}
+
+static int _ReadAheadThread(void *ptr) {
+    Kit_ReadAhead *ra = ptr;
+    const int64_t ahead = ra->capacity - ra->back_keep;
+
+    SDL_LockMutex(ra->lock);
+    while(!ra->quit) {
+        // Move the window to the requested position
+        if(ra->seeking) {
+            unsigned int generation = ra->generation;
+            int64_t target = ra->pos;
+            SDL_UnlockMutex(ra->lock);
+            int64_t ret = avio_seek(ra->inner, target, SEEK_SET);
+            SDL_LockMutex(ra->lock);
+            if(generation != ra->generation) {
+                continue;
+            }
+            ra->win_start = target;
+            ra->win_end = target;
+            ra->eof = false;
+            ra->error = (ret < 0);
+            ra->seeking = false;
+            SDL_CondBroadcast(ra->data_cond);
+            continue;
+        }
+
+        // Release bytes far enough behind the reader when the ring is full
+        int64_t used = ra->win_end - ra->win_start;
+        if(used == ra->capacity && ra->pos - ra->win_start > ra->back_keep) {
+            ra->win_start = ra->pos - ra->back_keep;
+            used = ra->win_end - ra->win_start;
+        }
+
+        if(ra->eof || ra->error || ra->win_end - ra->pos >= ahead || used == ra->capacity) {
+            SDL_CondWait(ra->fill_cond, ra->lock);
+            continue;
+        }
+
+        // Read straight into the free part of the ring. The reader never looks past win_end,
+        // and only this thread moves win_start, so the target range is ours while unlocked.
+        int64_t offset = ra->win_end % ra->capacity;
+        int64_t chunk = ra->capacity - offset;
+        if(chunk > ra->capacity - used) chunk = ra->capacity - used;
+        if(chunk > KIT_READAHEAD_CHUNK) chunk = KIT_READAHEAD_CHUNK;
+        unsigned int generation = ra->generation;
+        SDL_UnlockMutex(ra->lock);
+        int ret = avio_read(ra->inner, ra->ring + offset, chunk);
+        SDL_LockMutex(ra->lock);
+        if(generation != ra->generation) {
+            continue;
+        }
+        if(ret > 0) {
+            ra->win_end += ret;
+        } else if(ret == 0 || ret == AVERROR_EOF) {
+            ra->eof = true;
+        } else {
+            ra->error = true;
+        }
+        SDL_CondBroadcast(ra->data_cond);
+    }
+    SDL_UnlockMutex(ra->lock);
+    return 0;
+}
+
+static int _ReadAheadRead(void *opaque, uint8_t *buf, int size) {
+    Kit_ReadAhead *ra = opaque;
+    int ret = 0;
+
+    SDL_LockMutex(ra->lock);
+    while(!ra->quit) {
+        if(!ra->seeking && ra->pos < ra->win_end) {
+            int64_t offset = ra->pos % ra->capacity;
+            int64_t len = ra->win_end - ra->pos;
+            if(len > size) len = size;
+            if(len > ra->capacity - offset) len = ra->capacity - offset;
+            memcpy(buf, ra->ring + offset, len);
+            ra->pos += len;
+            ret = len;
+            SDL_CondSignal(ra->fill_cond);
+            break;
+        }
+        if(!ra->seeking && ra->eof) {
+            ret = AVERROR_EOF;
+            break;
+        }
+        if(!ra->seeking && ra->error) {
+            ret = AVERROR(EIO);
+            break;
+        }
+        SDL_CondWait(ra->data_cond, ra->lock);
+    }
+    SDL_UnlockMutex(ra->lock);
+    return ret;
+}
+
+static int64_t _ReadAheadSeek(void *opaque, int64_t offset, int whence) {
+    Kit_ReadAhead *ra = opaque;
+    int64_t pos;
+
+    whence &= ~AVSEEK_FORCE;
+    if(whence == AVSEEK_SIZE) {
+        return ra->size >= 0 ? ra->size : AVERROR(ENOSYS);
+    }
+
+    SDL_LockMutex(ra->lock);
+    switch(whence) {
+        case SEEK_SET: pos = offset; break;
+        case SEEK_CUR: pos = ra->pos + offset; break;
+        case SEEK_END:
+            if(ra->size < 0) {
+                SDL_UnlockMutex(ra->lock);
+                return AVERROR(ENOSYS);
+            }
+            pos = ra->size + offset;
+            break;
+        default:
+            SDL_UnlockMutex(ra->lock);
+            return AVERROR(EINVAL);
+    }
+    if(pos < 0) {
+        SDL_UnlockMutex(ra->lock);
+        return AVERROR(EINVAL);
+    }
+
+    // Seeks within the cached window (including short backward ones) are served from memory.
+    // Anything else invalidates the window and restarts the background reader at the new spot.
+    if(ra->seeking || pos < ra->win_start || pos > ra->win_end) {
+        ra->generation++;
+        ra->seeking = true;
+        SDL_CondSignal(ra->fill_cond);
+    }
+    ra->pos = pos;
+    SDL_UnlockMutex(ra->lock);
+    return pos;
+}
+
+static void _ReadAheadClose(void *opaque) {
+    Kit_ReadAhead *ra = opaque;
+    if(ra->thread != NULL) {
+        SDL_LockMutex(ra->lock);
+        ra->quit = true;
+        SDL_CondBroadcast(ra->fill_cond);
+        SDL_CondBroadcast(ra->data_cond);
+        SDL_UnlockMutex(ra->lock);
+        SDL_WaitThread(ra->thread, NULL);
+    }
+    if(ra->inner != NULL) {
+        avio_closep(&ra->inner);
+    }
+    if(ra->data_cond != NULL) {
+        SDL_DestroyCond(ra->data_cond);
+    }
+    if(ra->fill_cond != NULL) {
+        SDL_DestroyCond(ra->fill_cond);
+    }
+    if(ra->lock != NULL) {
+        SDL_DestroyMutex(ra->lock);
+    }
+    free(ra->ring);
+    free(ra);
+}
+
+Kit_Source* Kit_OpenReadAheadSource(const char *url, const Kit_SourceOptions *opts,
+                                    const AVIOInterruptCB *interrupt) {
+    assert(url != NULL);
+    assert(opts != NULL);
+
+    Kit_ReadAhead *ra = calloc(1, sizeof(Kit_ReadAhead));
+    if(ra == NULL) {
+        Kit_SetError("Unable to allocate read-ahead cache");
+        return NULL;
+    }
+    ra->capacity = (int64_t)opts->readahead_mb * 1024 * 1024;
+    ra->back_keep = ra->capacity / KIT_READAHEAD_BACK_DIVISOR;
+    ra->ring = malloc(ra->capacity);
+    if(ra->ring == NULL) {
+        Kit_SetError("Unable to allocate read-ahead cache");
+        goto exit_0;
+    }
+
+    ra->lock = SDL_CreateMutex();
+    ra->data_cond = SDL_CreateCond();
+    ra->fill_cond = SDL_CreateCond();
+    if(ra->lock == NULL || ra->data_cond == NULL || ra->fill_cond == NULL) {
+        Kit_SetError("Unable to allocate read-ahead locks");
+        goto exit_0;
+    }
+    if(interrupt != NULL) {
+        ra->interrupt = *interrupt;
+    }
+
+    AVIOInterruptCB inner_interrupt = { _ReadAheadInterrupt, ra };
+    if(avio_open2(&ra->inner, url, AVIO_FLAG_READ, &inner_interrupt, NULL) < 0) {
+        Kit_SetError("Unable to open source Url");
+        goto exit_0;
+    }
+    ra->size = avio_size(ra->inner);
+    ra->thread = SDL_CreateThread(_ReadAheadThread, "Kit Read-ahead Thread", ra);
+    if(ra->thread == NULL) {
+        Kit_SetError("Unable to create a read-ahead thread: %s", SDL_GetError());
+        goto exit_0;
+    }
+
+    // Far seeks can't be honoured without a seekable protocol underneath, so present such streams as non-seekable
+    Kit_Source *src = Kit_OpenCustomSource(url, _ReadAheadRead, ra->inner->seekable ? _ReadAheadSeek : NULL,
+                                           ra, _ReadAheadClose, KIT_AVIO_BUFFERSIZE, opts, interrupt);
+
+    // The caller's callback may go away once opening is done; the background thread keeps running
+    if(src != NULL) {
+        SDL_LockMutex(ra->lock);
+        ra->interrupt.callback = NULL;
+        ra->interrupt.opaque = NULL;
+        SDL_UnlockMutex(ra->lock);
+    }
+    return src;
+
+exit_0:
+    _ReadAheadClose(ra);
+    return NULL;
+}
@@ -0,0 +1,499 @@
+#include "kitchensink/kitsegments.h"
+#include "kitchensink/kiterror.h"
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_cpuinfo.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// Keyframe intervals decoded by a worker in one go
+#define KIT_SEGMENT_KEYFRAMES 4
+
+// Segments each worker may pick up ahead of the callback
+#define KIT_SEGMENT_LOOKAHEAD 2
+
+// Converted frames held for segments that are not yet handed to the callback, in bytes at most.
+// The segment handed out next is exempt, so at worst one segment more than this is held.
+#define KIT_SEGMENT_MAX_BYTES (128 * 1024 * 1024)
+
+typedef struct Kit_SegmentFrame {
+    SDL_Surface *surface;
+    double pts;
+} Kit_SegmentFrame;
+
+typedef struct Kit_Segment {
+    int64_t start_pts; ///< Pts of the keyframe starting the segment, in stream time base
+    int64_t end_pts; ///< Pts of the keyframe starting the next segment, INT64_MAX for the last one
+    int64_t start_pos; ///< Byte position of the starting keyframe
+    Kit_SegmentFrame *frames; ///< Decoded frames in presentation order
+    int count;
+    int capacity;
+    bool done; ///< Worker has finished with the segment, protected by the job lock
+    bool error; ///< Segment could not be decoded
+} Kit_Segment;
+
+typedef struct Kit_SegmentWorker {
+    AVFormatContext *format_ctx; ///< FFmpeg: Private demuxer
+    AVCodecContext *codec_ctx; ///< FFmpeg: Private decoder
+    AVFrame *frame; ///< FFmpeg: Decoder output frame
+    struct SwsContext *sws; ///< FFmpeg: Scaler to the output format, created on first frame
+    SDL_Thread *thread;
+    struct Kit_SegmentJob *job;
+} Kit_SegmentWorker;
+
+typedef struct Kit_SegmentJob {
+    int stream_idx;
+    double time_base; ///< Stream time base in seconds
+    int width; ///< Output width
+    int height; ///< Output height
+    Kit_Segment *segments;
+    int segment_count;
+    int next; ///< Next segment to be picked up by a worker, protected by lock
+    int emitted; ///< Segments already handed to the callback, protected by lock
+    int workers; ///< Number of decoding workers
+    int buffered; ///< Converted frames held in segments not yet emitted, protected by lock
+    int max_buffered; ///< Limit for buffered, from KIT_SEGMENT_MAX_BYTES
+    bool stop; ///< Callback asked to stop, protected by lock
+    SDL_mutex *lock;
+    SDL_cond *cond; ///< Signalled when a segment is done, or one has been emitted
+} Kit_SegmentJob;
+
+static void _CloseSegmentWorker(Kit_SegmentWorker *worker) {
+    sws_freeContext(worker->sws);
+    av_frame_free(&worker->frame);
+    if(worker->codec_ctx != NULL) {
+        avcodec_close(worker->codec_ctx);
+        avcodec_free_context(&worker->codec_ctx);
+    }
+    avformat_close_input(&worker->format_ctx);
+}
+
+static int _OpenSegmentWorker(Kit_SegmentWorker *worker, const char *path, int stream_idx) {
+    if(avformat_open_input(&worker->format_ctx, path, NULL, NULL) < 0) {
+        Kit_SetError("Unable to open source Url");
+        return 1;
+    }
+    if(avformat_find_stream_info(worker->format_ctx, NULL) < 0) {
+        Kit_SetError("Unable to fetch source information");
+        goto exit_0;
+    }
+    if(stream_idx < 0 || stream_idx >= (int)worker->format_ctx->nb_streams) {
+        Kit_SetError("Invalid video stream index: %d", stream_idx);
+        goto exit_0;
+    }
+    for(unsigned int i = 0; i < worker->format_ctx->nb_streams; i++) {
+        worker->format_ctx->streams[i]->discard = ((int)i == stream_idx) ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    }
+
+    AVStream *stream = worker->format_ctx->streams[stream_idx];
+    AVCodec *codec = avcodec_find_decoder(stream->codec->codec_id);
+    if(!codec) {
+        Kit_SetError("No suitable video decoder found");
+        goto exit_0;
+    }
+    worker->codec_ctx = avcodec_alloc_context3(codec);
+    if(worker->codec_ctx == NULL || avcodec_copy_context(worker->codec_ctx, stream->codec) != 0) {
+        Kit_SetError("Unable to copy video codec context");
+        goto exit_0;
+    }
+
+    // Parallelism comes from the segments; decoder threads would just compete with the other workers
+    worker->codec_ctx->thread_count = 1;
+    if(avcodec_open2(worker->codec_ctx, codec, NULL) < 0) {
+        Kit_SetError("Unable to allocate video codec context");
+        goto exit_0;
+    }
+    worker->frame = av_frame_alloc();
+    if(worker->frame == NULL) {
+        Kit_SetError("Unable to allocate video frame");
+        goto exit_0;
+    }
+    return 0;
+
+exit_0:
+    _CloseSegmentWorker(worker);
+    return 1;
+}
+
+static SDL_Surface* _ConvertSegmentFrame(Kit_SegmentWorker *worker) {
+    Kit_SegmentJob *job = worker->job;
+    AVFrame *frame = worker->frame;
+
+    // Same byte order as SDL_PIXELFORMAT_ABGR8888
+    Uint32 rmask, gmask, bmask, amask;
+    #if SDL_BYTEORDER == SDL_BIG_ENDIAN
+        rmask = 0xff000000;
+        gmask = 0x00ff0000;
+        bmask = 0x0000ff00;
+        amask = 0x000000ff;
+    #else
+        rmask = 0x000000ff;
+        gmask = 0x0000ff00;
+        bmask = 0x00ff0000;
+        amask = 0xff000000;
+    #endif
+
+    worker->sws = sws_getCachedContext(
+        worker->sws,
+        frame->width, frame->height, (enum AVPixelFormat)frame->format,
+        job->width, job->height, AV_PIX_FMT_RGBA,
+        SWS_BILINEAR, NULL, NULL, NULL);
+    if(worker->sws == NULL) {
+        return NULL;
+    }
+    SDL_Surface *surface = SDL_CreateRGBSurface(0, job->width, job->height, 32, rmask, gmask, bmask, amask);
+    if(surface == NULL) {
+        return NULL;
+    }
+    unsigned char *dst_data[4] = { surface->pixels, NULL, NULL, NULL };
+    int dst_linesize[4] = { surface->pitch, 0, 0, 0 };
+    sws_scale(worker->sws, (const unsigned char * const *)frame->data, frame->linesize, 0, frame->height, dst_data, dst_linesize);
+    return surface;
+}
+
+static int _AddSegmentFrame(Kit_Segment *segment, SDL_Surface *surface, double pts) {
+    if(segment->count == segment->capacity) {
+        int capacity = segment->capacity > 0 ? segment->capacity * 2 : 64;
+        Kit_SegmentFrame *frames = realloc(segment->frames, capacity * sizeof(Kit_SegmentFrame));
+        if(frames == NULL) {
+            return 1;
+        }
+        segment->frames = frames;
+        segment->capacity = capacity;
+    }
+
+    // Decoders output in presentation order, so this is nearly always a plain append
+    int i = segment->count;
+    while(i > 0 && segment->frames[i - 1].pts > pts) {
+        segment->frames[i] = segment->frames[i - 1];
+        i--;
+    }
+    segment->frames[i].surface = surface;
+    segment->frames[i].pts = pts;
+    segment->count++;
+    return 0;
+}
+
+// Waits until the frame budget allows one more frame for the segment. The segment to be handed out
+// next never waits, so the callback always makes progress and frees up room for the others.
+// Returns nonzero if decoding was stopped meanwhile.
+static int _ReserveSegmentFrame(Kit_SegmentJob *job, const Kit_Segment *segment) {
+    int idx = segment - job->segments;
+    SDL_LockMutex(job->lock);
+    while(!job->stop && idx != job->emitted && job->buffered >= job->max_buffered) {
+        SDL_CondWait(job->cond, job->lock);
+    }
+    bool stop = job->stop;
+    if(!stop) {
+        job->buffered++;
+    }
+    SDL_UnlockMutex(job->lock);
+    return stop;
+}
+
+static void _ReleaseSegmentFrames(Kit_SegmentJob *job, int count) {
+    SDL_LockMutex(job->lock);
+    job->buffered -= count;
+    SDL_CondBroadcast(job->cond);
+    SDL_UnlockMutex(job->lock);
+}
+
+// Decodes the packet (or drains the decoder, if packet is empty), keeping frames inside the segment
+static int _DecodeSegmentPacket(Kit_SegmentWorker *worker, Kit_Segment *segment, AVPacket *packet) {
+    Kit_SegmentJob *job = worker->job;
+    int frame_finished;
+    do {
+        int len = avcodec_decode_video2(worker->codec_ctx, worker->frame, &frame_finished, packet);
+        if(len < 0) {
+            return 0;
+        }
+        if(frame_finished) {
+            // Leading frames of the next keyframe interval still belong here, and the ones
+            // before the start belong to the previous segment.
+            int64_t pts = av_frame_get_best_effort_timestamp(worker->frame);
+            if(pts != AV_NOPTS_VALUE && pts >= segment->start_pts && pts < segment->end_pts) {
+                if(_ReserveSegmentFrame(job, segment) != 0) {
+                    return 1;
+                }
+                SDL_Surface *surface = _ConvertSegmentFrame(worker);
+                if(surface == NULL || _AddSegmentFrame(segment, surface, pts * job->time_base) != 0) {
+                    if(surface != NULL) {
+                        SDL_FreeSurface(surface);
+                    }
+                    _ReleaseSegmentFrames(job, 1);
+                    return 1;
+                }
+            }
+        }
+        if(packet->size > 0) {
+            packet->size -= len;
+            packet->data += len;
+        }
+    } while(packet->size > 0 || (packet->data == NULL && frame_finished));
+    return 0;
+}
+
+static int _DecodeSegment(Kit_SegmentWorker *worker, Kit_Segment *segment) {
+    Kit_SegmentJob *job = worker->job;
+    AVFormatContext *format_ctx = worker->format_ctx;
+    AVPacket packet;
+    bool started = false;
+    bool reached_end = false;
+    int err = 0;
+
+    // Byte seeks go straight to the keyframe. Formats without them seek by the keyframe pts.
+    avcodec_flush_buffers(worker->codec_ctx);
+    if((format_ctx->iformat->flags & AVFMT_NO_BYTE_SEEK)
+        || av_seek_frame(format_ctx, -1, segment->start_pos, AVSEEK_FLAG_BYTE) < 0)
+    {
+        if(avformat_seek_file(format_ctx, job->stream_idx, INT64_MIN, segment->start_pts, segment->start_pts, 0) < 0) {
+            return 1;
+        }
+    }
+
+    av_init_packet(&packet);
+    while(!err && av_read_frame(format_ctx, &packet) >= 0) {
+        int64_t pts = (packet.pts != AV_NOPTS_VALUE) ? packet.pts : packet.dts;
+        bool is_key = (packet.flags & AV_PKT_FLAG_KEY) != 0;
+        if(packet.stream_index != job->stream_idx) {
+            av_packet_unref(&packet);
+            continue;
+        }
+
+        // Start decoding from the segment's own keyframe
+        if(!started) {
+            if(!is_key || pts < segment->start_pts) {
+                av_packet_unref(&packet);
+                continue;
+            }
+            started = true;
+        }
+
+        // The next segment's keyframe is still decoded, along with the frames that follow it
+        // but are presented before it. Anything else from there on is left to the next segment.
+        if(pts != AV_NOPTS_VALUE && pts >= segment->end_pts) {
+            if(reached_end || !is_key) {
+                av_packet_unref(&packet);
+                break;
+            }
+            reached_end = true;
+        }
+
+        AVPacket data = packet;
+        err = _DecodeSegmentPacket(worker, segment, &data);
+        av_packet_unref(&packet);
+    }
+
+    // Drain frames still held back by the decoder
+    if(!err) {
+        AVPacket flush;
+        av_init_packet(&flush);
+        flush.data = NULL;
+        flush.size = 0;
+        err = _DecodeSegmentPacket(worker, segment, &flush);
+    }
+    return err;
+}
+
+static int _SegmentThread(void *ptr) {
+    Kit_SegmentWorker *worker = ptr;
+    Kit_SegmentJob *job = worker->job;
+
+    SDL_LockMutex(job->lock);
+    while(!job->stop && job->next < job->segment_count) {
+        if(job->next >= job->emitted + job->workers * KIT_SEGMENT_LOOKAHEAD) {
+            SDL_CondWait(job->cond, job->lock);
+            continue;
+        }
+        Kit_Segment *segment = &job->segments[job->next++];
+        SDL_UnlockMutex(job->lock);
+        bool error = _DecodeSegment(worker, segment) != 0;
+        SDL_LockMutex(job->lock);
+        segment->error = error;
+        segment->done = true;
+        SDL_CondBroadcast(job->cond);
+    }
+    SDL_UnlockMutex(job->lock);
+    return 0;
+}
+
+static void _FreeSegmentFrames(Kit_Segment *segment) {
+    for(int i = 0; i < segment->count; i++) {
+        SDL_FreeSurface(segment->frames[i].surface);
+    }
+    free(segment->frames);
+    segment->frames = NULL;
+    segment->count = 0;
+    segment->capacity = 0;
+}
+
+int Kit_DecodeFileParallel(const char *path, const Kit_KeyframeIndex *index,
+                           int width, int height, int threads,
+                           Kit_DecodedFrameCallback frame_cb, void *userdata)
+{
+    assert(path != NULL);
+    assert(frame_cb != NULL);
+    Kit_KeyframeIndex *own_index = NULL;
+    Kit_SegmentWorker *workers = NULL;
+    Kit_SegmentJob job;
+    int ret = 1;
+
+    // Segments are cut at keyframes, so one is needed to get started
+    if(index == NULL) {
+        own_index = Kit_BuildKeyframeIndex(path, -1);
+        if(own_index == NULL) {
+            return 1;
+        }
+        index = own_index;
+    }
+    if(index->count == 0) {
+        Kit_SetError("No keyframes found in %s", path);
+        goto exit_0;
+    }
+
+    memset(&job, 0, sizeof(Kit_SegmentJob));
+    job.stream_idx = index->stream_idx;
+    job.time_base = (double)index->tb_num / index->tb_den;
+    job.segment_count = (index->count + KIT_SEGMENT_KEYFRAMES - 1) / KIT_SEGMENT_KEYFRAMES;
+    job.segments = calloc(job.segment_count, sizeof(Kit_Segment));
+    if(job.segments == NULL) {
+        Kit_SetError("Unable to allocate segments");
+        goto exit_0;
+    }
+    for(int i = 0; i < job.segment_count; i++) {
+        int first = i * KIT_SEGMENT_KEYFRAMES;
+        int last = first + KIT_SEGMENT_KEYFRAMES;
+        job.segments[i].start_pts = index->pts[first];
+        job.segments[i].start_pos = index->pos[first];
+        job.segments[i].end_pts = (last < index->count) ? index->pts[last] : INT64_MAX;
+    }
+
+    if(threads <= 0) {
+        threads = SDL_GetCPUCount();
+    }
+    if(threads > job.segment_count) {
+        threads = job.segment_count;
+    }
+    job.workers = threads;
+
+    // Every worker has a demuxer and decoder of its own. Open them up front, so that a file
+    // that can't be decoded fails right here instead of halfway through.
+    workers = calloc(threads, sizeof(Kit_SegmentWorker));
+    if(workers == NULL) {
+        Kit_SetError("Unable to allocate segment workers");
+        goto exit_1;
+    }
+    int opened;
+    for(opened = 0; opened < threads; opened++) {
+        workers[opened].job = &job;
+        if(_OpenSegmentWorker(&workers[opened], path, job.stream_idx) != 0) {
+            goto exit_2;
+        }
+    }
+
+    // Missing dimensions follow the aspect ratio of the video
+    int video_w = workers[0].codec_ctx->width;
+    int video_h = workers[0].codec_ctx->height;
+    if(width <= 0 && height <= 0) {
+        width = video_w;
+        height = video_h;
+    } else if(width <= 0 && video_h > 0) {
+        width = (int64_t)height * video_w / video_h;
+    } else if(height <= 0 && video_w > 0) {
+        height = (int64_t)width * video_h / video_w;
+    }
+    if(width <= 0 || height <= 0) {
+        Kit_SetError("Invalid output size %dx%d", width, height);
+        goto exit_2;
+    }
+    job.width = width;
+    job.height = height;
+    job.max_buffered = KIT_SEGMENT_MAX_BYTES / ((int64_t)width * height * 4);
+    if(job.max_buffered < 1) {
+        job.max_buffered = 1;
+    }
+
+    job.lock = SDL_CreateMutex();
+    if(job.lock == NULL) {
+        Kit_SetError("Unable to allocate segment lock");
+        goto exit_2;
+    }
+    job.cond = SDL_CreateCond();
+    if(job.cond == NULL) {
+        Kit_SetError("Unable to allocate segment condition");
+        goto exit_3;
+    }
+    int started = 0;
+    for(int i = 0; i < threads; i++) {
+        workers[i].thread = SDL_CreateThread(_SegmentThread, "Kit Segment Thread", &workers[i]);
+        if(workers[i].thread != NULL) {
+            started++;
+        }
+    }
+    if(started == 0) {
+        Kit_SetError("Unable to create segment threads: %s", SDL_GetError());
+        goto exit_4;
+    }
+
+    // Hand out segments in order as they complete
+    ret = 0;
+    for(int i = 0; i < job.segment_count && !job.stop; i++) {
+        Kit_Segment *segment = &job.segments[i];
+        SDL_LockMutex(job.lock);
+        while(!segment->done) {
+            SDL_CondWait(job.cond, job.lock);
+        }
+        SDL_UnlockMutex(job.lock);
+
+        bool stop = false;
+        if(segment->error) {
+            Kit_SetError("Unable to decode segment at %f", segment->start_pts * job.time_base);
+            ret = 1;
+            stop = true;
+        }
+        for(int k = 0; k < segment->count && !stop; k++) {
+            stop = frame_cb(segment->frames[k].surface, segment->frames[k].pts, userdata) != 0;
+        }
+        int count = segment->count;
+        _FreeSegmentFrames(segment);
+
+        SDL_LockMutex(job.lock);
+        job.buffered -= count;
+        job.emitted++;
+        job.stop = stop;
+        SDL_CondBroadcast(job.cond);
+        SDL_UnlockMutex(job.lock);
+    }
+
+    for(int i = 0; i < threads; i++) {
+        if(workers[i].thread != NULL) {
+            SDL_WaitThread(workers[i].thread, NULL);
+        }
+    }
+    for(int i = 0; i < job.segment_count; i++) {
+        _FreeSegmentFrames(&job.segments[i]);
+    }
+
+exit_4:
+    SDL_DestroyCond(job.cond);
+exit_3:
+    SDL_DestroyMutex(job.lock);
+exit_2:
+    for(int i = 0; i < opened; i++) {
+        _CloseSegmentWorker(&workers[i]);
+    }
+    free(workers);
+exit_1:
+    free(job.segments);
+exit_0:
+    Kit_FreeKeyframeIndex(own_index);
+    return ret;
+}
@@ -1,97 +1,501 @@
 #include "kitchensink/kitsource.h"
 #include "kitchensink/kiterror.h"
+#include "kitchensink/internal/kitprobecache.h"
+#include "kitchensink/internal/kitsourceio.h"
+#include "kitchensink/internal/kitthumbnailcache.h"
+#include "kitchensink/internal/kiterrorcapture.h"
 
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/opt.h>
 
+#include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_stdinc.h>
+
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
+#include <limits.h>
+#include <errno.h>
 #include <assert.h>
 
-Kit_Source* Kit_CreateSourceFromMemory(cached_file * cf) {
+// Live sources probe only as much as it takes to find the codec parameters.
+#define KIT_LIVE_PROBESIZE 32768
+#define KIT_LIVE_ANALYZEDURATION 100000
+
+typedef struct Kit_MemoryReader {
+    const unsigned char *data; ///< Caller owned blob; never copied or freed here
+    int64_t size; ///< Blob size in bytes
+    int64_t pos; ///< Current read position
+} Kit_MemoryReader;
+
+typedef struct Kit_CallbackReader {
+    Kit_ReadCallback read_cb; ///< User read callback
+    Kit_SeekCallback seek_cb; ///< User seek callback, NULL if the stream is not seekable
+    Kit_SizeCallback size_cb; ///< User size callback, NULL if the size is unknown
+    void *userdata; ///< User data; owned by the caller
+} Kit_CallbackReader;
+
+void Kit_InitSourceOptions(Kit_SourceOptions *opts) {
+    assert(opts != NULL);
+    memset(opts, 0, sizeof(Kit_SourceOptions));
+
+    // Analyze as much as needed by default; this is the most robust, but also the slowest choice.
+    opts->probesize = INT_MAX;
+    opts->analyzeduration = INT_MAX;
+}
+
+static Kit_Source* _OpenSource(AVFormatContext *format_ctx, const char *url, const Kit_SourceOptions *opts,
+                               const AVIOInterruptCB *interrupt) {
+    AVInputFormat *in_fmt = NULL;
+    AVDictionary *dict = NULL;
+
+    // Only sources opened by path or url have something to key the probe cache on
+    bool use_cache = (opts->cache_dir != NULL && url[0] != '\0' && !opts->is_live);
+
     Kit_Source *src = calloc(1, sizeof(Kit_Source));
     if(src == NULL) {
         Kit_SetError("Unable to allocate source");
-        return NULL;
+        goto exit_0;
     }
 
-    // Attempt to open source
-	AVFormatContext * avFormat = avformat_alloc_context();
-	avFormat->pb = avio_alloc_context(	cf->file_pointer,
-										cf->filesize,
-										0,
-										NULL,
-										NULL,
-										NULL,
-										NULL);
-	if(avformat_open_input(&avFormat,"dummyFilename", NULL,NULL) < 0) {
-        Kit_SetError("Unable to open source Url");
-        goto exit_0;
+    // Blocking I/O can only be interrupted if the context exists before opening
+    if(interrupt != NULL) {
+        if(format_ctx == NULL) {
+            format_ctx = avformat_alloc_context();
+            if(format_ctx == NULL) {
+                Kit_SetError("Unable to allocate format context");
+                goto exit_1;
+            }
+        }
+        format_ctx->interrupt_callback = *interrupt;
     }
 
-    av_opt_set_int(src->format_ctx, "probesize", INT_MAX, 0);
-    av_opt_set_int(src->format_ctx, "analyzeduration", INT_MAX, 0);
+    // Skip container autodetection if the caller already knows the format
+    if(opts->format != NULL) {
+        in_fmt = av_find_input_format(opts->format);
+        if(in_fmt == NULL) {
+            Kit_SetError("Unknown source format %s", opts->format);
+            goto exit_1;
+        }
+    }
+
+    // Probing limits apply to both container detection and stream analysis
+    if(opts->probesize > 0) {
+        av_dict_set_int(&dict, "probesize", opts->probesize, 0);
+    }
+    if(opts->analyzeduration > 0) {
+        av_dict_set_int(&dict, "analyzeduration", opts->analyzeduration, 0);
+    }
+    if(opts->is_live) {
+        av_dict_set(&dict, "fflags", "nobuffer", 0);
+    }
 
-    // Fetch stream information. This may potentially take a while.
-    if(avformat_find_stream_info((AVFormatContext *)src->format_ctx, NULL) < 0) {
-        Kit_SetError("Unable to fetch source information");
+    // Attempt to open source. Note that format_ctx is freed by avformat_open_input on failure.
+    src->format_ctx = format_ctx;
+    if(avformat_open_input((AVFormatContext **)&src->format_ctx, url, in_fmt, &dict) < 0) {
+        Kit_SetError("Unable to open source Url");
+        format_ctx = NULL;
         goto exit_1;
     }
 
+    // Fetch stream information. This may potentially take a while, depending on probing limits.
+    // If an earlier open of the same file left its results in the cache, restore those instead.
+    if(!opts->skip_stream_info) {
+        if(use_cache && Kit_LoadProbeCache(src->format_ctx, opts->cache_dir, url) == 0) {
+            src->from_probe_cache = true;
+        } else {
+            if(avformat_find_stream_info((AVFormatContext *)src->format_ctx, NULL) < 0) {
+                Kit_SetError("Unable to fetch source information");
+                goto exit_2;
+            }
+            if(use_cache) {
+                Kit_SaveProbeCache(src->format_ctx, opts->cache_dir, url);
+            }
+        }
+    }
+
     // Find best streams for defaults
     src->astream_idx = Kit_GetBestSourceStream(src, KIT_STREAMTYPE_AUDIO);
     src->vstream_idx = Kit_GetBestSourceStream(src, KIT_STREAMTYPE_VIDEO);
     src->sstream_idx = Kit_GetBestSourceStream(src, KIT_STREAMTYPE_SUBTITLE);
+    src->is_live = opts->is_live;
+    av_dict_free(&dict);
     return src;
 
-exit_1:
+exit_2:
     avformat_close_input((AVFormatContext **)&src->format_ctx);
-exit_0:
+    format_ctx = NULL;
+exit_1:
+    av_dict_free(&dict);
     free(src);
+exit_0:
+    avformat_free_context(format_ctx);
+    return NULL;
+}
+
+Kit_Source* Kit_OpenCustomSource(const char *url,
+                                 Kit_SourceReadCallback read_cb,
+                                 Kit_SourceSeekCallback seek_cb,
+                                 void *opaque,
+                                 Kit_SourceCloseCallback close_cb,
+                                 int buffer_size,
+                                 const Kit_SourceOptions *opts,
+                                 const AVIOInterruptCB *interrupt) {
+    AVIOContext *avio_ctx = NULL;
+    AVFormatContext *format_ctx = NULL;
+
+    unsigned char *buffer = av_malloc(buffer_size);
+    if(buffer == NULL) {
+        Kit_SetError("Unable to allocate IO buffer");
+        goto exit_0;
+    }
+    avio_ctx = avio_alloc_context(buffer, buffer_size, 0, opaque, read_cb, NULL, seek_cb);
+    if(avio_ctx == NULL) {
+        Kit_SetError("Unable to allocate IO context");
+        av_free(buffer);
+        goto exit_0;
+    }
+    format_ctx = avformat_alloc_context();
+    if(format_ctx == NULL) {
+        Kit_SetError("Unable to allocate format context");
+        goto exit_1;
+    }
+    format_ctx->pb = avio_ctx;
+
+    // Format context is always released by _OpenSource on failure, but custom IO context is not.
+    Kit_Source *src = _OpenSource(format_ctx, url != NULL ? url : "", opts, interrupt);
+    if(src == NULL) {
+        goto exit_1;
+    }
+    src->avio_ctx = avio_ctx;
+    src->io_opaque = opaque;
+    src->io_close = close_cb;
+    return src;
+
+exit_1:
+    // FFmpeg may have swapped the buffer, so free whatever the context holds now
+    av_freep(&avio_ctx->buffer);
+    av_freep(&avio_ctx);
+exit_0:
+    if(close_cb != NULL) {
+        close_cb(opaque);
+    }
     return NULL;
 }
 
+static int _MemoryRead(void *opaque, uint8_t *buf, int size) {
+    Kit_MemoryReader *reader = opaque;
+    int64_t left = reader->size - reader->pos;
+    if(left <= 0) {
+        return AVERROR_EOF;
+    }
+    if(size > left) {
+        size = left;
+    }
+    memcpy(buf, reader->data + reader->pos, size);
+    reader->pos += size;
+    return size;
+}
+
+static int64_t _MemorySeek(void *opaque, int64_t offset, int whence) {
+    Kit_MemoryReader *reader = opaque;
+    int64_t pos;
+    switch(whence & ~AVSEEK_FORCE) {
+        case AVSEEK_SIZE: return reader->size;
+        case SEEK_SET: pos = offset; break;
+        case SEEK_CUR: pos = reader->pos + offset; break;
+        case SEEK_END: pos = reader->size + offset; break;
+        default:
+            return AVERROR(EINVAL);
+    }
+    if(pos < 0 || pos > reader->size) {
+        return AVERROR(EINVAL);
+    }
+    reader->pos = pos;
+    return pos;
+}
+
+Kit_Source* Kit_CreateSourceFromMemoryWithOptions(cached_file * cf, const Kit_SourceOptions *opts) {
+    assert(cf != NULL);
+    assert(opts != NULL);
+
+    // FFmpeg reads through its own small buffer; the blob itself stays owned by the caller.
+    Kit_MemoryReader *reader = calloc(1, sizeof(Kit_MemoryReader));
+    if(reader == NULL) {
+        Kit_SetError("Unable to allocate memory reader");
+        return NULL;
+    }
+    reader->data = cf->file_pointer;
+    reader->size = cf->filesize;
+    return Kit_OpenCustomSource(NULL, _MemoryRead, _MemorySeek, reader, free, KIT_AVIO_BUFFERSIZE, opts, NULL);
+}
+
+static int _CallbackRead(void *opaque, uint8_t *buf, int size) {
+    Kit_CallbackReader *reader = opaque;
+    int ret = reader->read_cb(reader->userdata, buf, size);
+    if(ret == 0) {
+        return AVERROR_EOF;
+    }
+    if(ret < 0) {
+        return AVERROR(EIO);
+    }
+    return ret;
+}
+
+static int64_t _CallbackSeek(void *opaque, int64_t offset, int whence) {
+    Kit_CallbackReader *reader = opaque;
+    whence &= ~AVSEEK_FORCE;
+    if(whence == AVSEEK_SIZE) {
+        if(reader->size_cb == NULL) {
+            return AVERROR(ENOSYS);
+        }
+        int64_t size = reader->size_cb(reader->userdata);
+        return size < 0 ? AVERROR(ENOSYS) : size;
+    }
+    int64_t pos = reader->seek_cb(reader->userdata, offset, whence);
+    return pos < 0 ? AVERROR(EIO) : pos;
+}
+
+Kit_Source* Kit_CreateSourceFromCallbacks(Kit_ReadCallback read_cb,
+                                          Kit_SeekCallback seek_cb,
+                                          Kit_SizeCallback size_cb,
+                                          void *userdata,
+                                          int buffer_size) {
+    assert(read_cb != NULL);
+
+    Kit_CallbackReader *reader = calloc(1, sizeof(Kit_CallbackReader));
+    if(reader == NULL) {
+        Kit_SetError("Unable to allocate callback reader");
+        return NULL;
+    }
+    reader->read_cb = read_cb;
+    reader->seek_cb = seek_cb;
+    reader->size_cb = size_cb;
+    reader->userdata = userdata;
+    if(buffer_size <= 0) {
+        buffer_size = KIT_AVIO_BUFFERSIZE;
+    }
+
+    // Without a seek callback FFmpeg treats the stream as non-seekable
+    Kit_SourceOptions opts;
+    Kit_InitSourceOptions(&opts);
+    return Kit_OpenCustomSource(NULL, _CallbackRead, seek_cb != NULL ? _CallbackSeek : NULL,
+                                reader, free, buffer_size, &opts, NULL);
+}
+
+Kit_Source* Kit_CreateSourceFromMemory(cached_file * cf) {
+    Kit_SourceOptions opts;
+    Kit_InitSourceOptions(&opts);
+    return Kit_CreateSourceFromMemoryWithOptions(cf, &opts);
+}
+
+// Picks the IO layer requested by the options. Used by both blocking and asynchronous opens.
+static Kit_Source* _OpenUrlSource(const char *url, const Kit_SourceOptions *opts, const AVIOInterruptCB *interrupt) {
+#ifndef _WIN32
+    if(opts->queued_io && !opts->is_live) {
+        return Kit_OpenQueuedFileSource(url, opts, interrupt);
+    }
+#endif
+
+    // Live sources are consumed as they arrive, so reading ahead would only add latency
+    if(opts->readahead_mb > 0 && !opts->is_live) {
+        return Kit_OpenReadAheadSource(url, opts, interrupt);
+    }
+    return _OpenSource(NULL, url, opts, interrupt);
+}
+
+Kit_Source* Kit_CreateSourceFromUrlWithOptions(const char *url, const Kit_SourceOptions *opts) {
+    assert(url != NULL);
+    assert(opts != NULL);
+    return _OpenUrlSource(url, opts, NULL);
+}
+
 Kit_Source* Kit_CreateSourceFromUrl(const char *url) {
+    Kit_SourceOptions opts;
+    Kit_InitSourceOptions(&opts);
+    return Kit_CreateSourceFromUrlWithOptions(url, &opts);
+}
+
+Kit_Source* Kit_CreateLiveSourceFromUrl(const char *url) {
+    // Probe minimally, and hand out packets as soon as they arrive.
+    Kit_SourceOptions opts;
+    Kit_InitSourceOptions(&opts);
+    opts.probesize = KIT_LIVE_PROBESIZE;
+    opts.analyzeduration = KIT_LIVE_ANALYZEDURATION;
+    opts.is_live = true;
+    return Kit_CreateSourceFromUrlWithOptions(url, &opts);
+}
+
+static int _AsyncSourceInterrupt(void *ptr) {
+    Kit_AsyncSource *handle = ptr;
+    int cancelled = 0;
+    if(SDL_LockMutex(handle->lock) == 0) {
+        cancelled = handle->cancelled;
+        SDL_UnlockMutex(handle->lock);
+    }
+    return cancelled;
+}
+
+static int _AsyncSourceThread(void *ptr) {
+    Kit_AsyncSource *handle = ptr;
+    AVIOInterruptCB interrupt = { _AsyncSourceInterrupt, handle };
+
+    // Errors of this thread go to the handle, and never touch the global error message
+    Kit_CaptureErrors(handle->error, KIT_ASYNCERRORSIZE);
+    Kit_Source *src = _OpenUrlSource(handle->url, &handle->opts, &interrupt);
+    Kit_CaptureErrors(NULL, 0);
+
+    // The handle may be freed before the source is, so it must not be referenced after this.
+    if(src != NULL) {
+        AVFormatContext *format_ctx = (AVFormatContext *)src->format_ctx;
+        format_ctx->interrupt_callback.callback = NULL;
+        format_ctx->interrupt_callback.opaque = NULL;
+    }
+
+    Kit_AsyncSourceState state = KIT_ASYNC_FAILED;
+    if(SDL_LockMutex(handle->lock) == 0) {
+        if(handle->cancelled) {
+            state = KIT_ASYNC_CANCELLED;
+        } else if(src != NULL) {
+            state = KIT_ASYNC_READY;
+            handle->src = src;
+            src = NULL;
+        } else if(handle->error[0] == 0) {
+            SDL_strlcpy(handle->error, "Unable to open source", KIT_ASYNCERRORSIZE);
+        }
+        handle->state = state;
+        SDL_UnlockMutex(handle->lock);
+    }
+    if(src != NULL) {
+        Kit_CloseSource(src);
+    }
+
+    if(handle->cb != NULL) {
+        handle->cb(handle, state, handle->userdata);
+    }
+    return 0;
+}
+
+static void _FreeAsyncSource(Kit_AsyncSource *handle) {
+    if(handle->lock != NULL) {
+        SDL_DestroyMutex(handle->lock);
+    }
+    SDL_free(handle->url);
+    SDL_free((char*)handle->opts.format);
+    SDL_free((char*)handle->opts.cache_dir);
+    free(handle);
+}
+
+Kit_AsyncSource* Kit_CreateSourceAsync(const char *url, const Kit_SourceOptions *opts,
+                                       Kit_AsyncSourceCallback cb, void *userdata) {
     assert(url != NULL);
 
-    Kit_Source *src = calloc(1, sizeof(Kit_Source));
-    if(src == NULL) {
-        Kit_SetError("Unable to allocate source");
+    Kit_AsyncSource *handle = calloc(1, sizeof(Kit_AsyncSource));
+    if(handle == NULL) {
+        Kit_SetError("Unable to allocate async source");
         return NULL;
     }
 
-    // Attempt to open source
-    if(avformat_open_input((AVFormatContext **)&src->format_ctx, url, NULL, NULL) < 0) {
-        Kit_SetError("Unable to open source Url");
+    // Take copies, so that the caller is free to release its own strings right away
+    if(opts != NULL) {
+        handle->opts = *opts;
+    } else {
+        Kit_InitSourceOptions(&handle->opts);
+    }
+    handle->url = SDL_strdup(url);
+    handle->opts.format = (opts != NULL && opts->format != NULL) ? SDL_strdup(opts->format) : NULL;
+    handle->opts.cache_dir = (opts != NULL && opts->cache_dir != NULL) ? SDL_strdup(opts->cache_dir) : NULL;
+    if(handle->url == NULL
+        || (opts != NULL && opts->format != NULL && handle->opts.format == NULL)
+        || (opts != NULL && opts->cache_dir != NULL && handle->opts.cache_dir == NULL)) {
+        Kit_SetError("Unable to allocate async source");
         goto exit_0;
     }
+    handle->cb = cb;
+    handle->userdata = userdata;
+    handle->state = KIT_ASYNC_PENDING;
 
-    av_opt_set_int(src->format_ctx, "probesize", INT_MAX, 0);
-    av_opt_set_int(src->format_ctx, "analyzeduration", INT_MAX, 0);
-
-    // Fetch stream information. This may potentially take a while.
-    if(avformat_find_stream_info((AVFormatContext *)src->format_ctx, NULL) < 0) {
-        Kit_SetError("Unable to fetch source information");
-        goto exit_1;
+    handle->lock = SDL_CreateMutex();
+    if(handle->lock == NULL) {
+        Kit_SetError("Unable to allocate async source mutex");
+        goto exit_0;
     }
 
-    // Find best streams for defaults
-    src->astream_idx = Kit_GetBestSourceStream(src, KIT_STREAMTYPE_AUDIO);
-    src->vstream_idx = Kit_GetBestSourceStream(src, KIT_STREAMTYPE_VIDEO);
-    src->sstream_idx = Kit_GetBestSourceStream(src, KIT_STREAMTYPE_SUBTITLE);
-    return src;
+    handle->thread = SDL_CreateThread(_AsyncSourceThread, "Kit Source Thread", handle);
+    if(handle->thread == NULL) {
+        Kit_SetError("Unable to create a source thread: %s", SDL_GetError());
+        goto exit_0;
+    }
+    return handle;
 
-exit_1:
-    avformat_close_input((AVFormatContext **)&src->format_ctx);
 exit_0:
-    free(src);
+    _FreeAsyncSource(handle);
     return NULL;
 }
 
+Kit_AsyncSourceState Kit_GetAsyncSourceState(Kit_AsyncSource *handle) {
+    assert(handle != NULL);
+    Kit_AsyncSourceState state = KIT_ASYNC_PENDING;
+    if(SDL_LockMutex(handle->lock) == 0) {
+        state = handle->state;
+        SDL_UnlockMutex(handle->lock);
+    }
+    return state;
+}
+
+const char* Kit_GetAsyncSourceError(Kit_AsyncSource *handle) {
+    assert(handle != NULL);
+    if(Kit_GetAsyncSourceState(handle) != KIT_ASYNC_FAILED) {
+        return NULL;
+    }
+    return handle->error;
+}
+
+Kit_Source* Kit_TakeAsyncSource(Kit_AsyncSource *handle) {
+    assert(handle != NULL);
+    Kit_Source *src = NULL;
+    if(SDL_LockMutex(handle->lock) == 0) {
+        src = handle->src;
+        handle->src = NULL;
+        SDL_UnlockMutex(handle->lock);
+    }
+    return src;
+}
+
+void Kit_CancelAsyncSource(Kit_AsyncSource *handle) {
+    assert(handle != NULL);
+    if(SDL_LockMutex(handle->lock) == 0) {
+        handle->cancelled = true;
+        SDL_UnlockMutex(handle->lock);
+    }
+}
+
+void Kit_CloseAsyncSource(Kit_AsyncSource *handle) {
+    if(handle == NULL) return;
+
+    // Interrupt any blocking I/O, then wait for the thread to notice
+    Kit_CancelAsyncSource(handle);
+    SDL_WaitThread(handle->thread, NULL);
+    if(handle->src != NULL) {
+        Kit_CloseSource(handle->src);
+    }
+    _FreeAsyncSource(handle);
+}
+
 void Kit_CloseSource(Kit_Source *src) {
     assert(src != NULL);
+    Kit_FreeThumbnailCache(src->thumb_cache);
     avformat_close_input((AVFormatContext **)&src->format_ctx);
+    if(src->avio_ctx != NULL) {
+        AVIOContext *avio_ctx = src->avio_ctx;
+        av_freep(&avio_ctx->buffer);
+        av_freep(&src->avio_ctx);
+    }
+    if(src->io_close != NULL) {
+        src->io_close(src->io_opaque);
+    }
     free(src);
 }
 
@@ -0,0 +1,385 @@
+#include "kitchensink/kitthumbnail.h"
+#include "kitchensink/kiterror.h"
+#include "kitchensink/internal/kitthumbnailcache.h"
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+
+#include <SDL2/SDL.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// Thumbnails kept per source
+#define KIT_THUMBNAIL_CACHE_SIZE 32
+
+// Packets read after the seek point at most, while looking for a decodable keyframe
+#define KIT_THUMBNAIL_MAX_PACKETS 512
+
+typedef struct Kit_ThumbnailEntry {
+    int64_t pos; ///< Byte position of the keyframe the thumbnail was made from
+    int width; ///< Thumbnail width
+    int height; ///< Thumbnail height
+    unsigned int last_used; ///< Cache clock value of the last hit; 0 if the entry is empty
+    SDL_Surface *surface; ///< Thumbnail pixels
+} Kit_ThumbnailEntry;
+
+typedef struct Kit_ThumbnailCache {
+    AVFormatContext *format_ctx; ///< FFmpeg: Private demuxer, so that players using the source are never disturbed
+    int stream_idx; ///< Video stream index
+    unsigned int clock; ///< Incremented on every lookup
+    unsigned int hits; ///< Lookups served without touching the demuxer
+    unsigned int misses; ///< Lookups that had to read and decode a keyframe
+    Kit_ThumbnailEntry entries[KIT_THUMBNAIL_CACHE_SIZE];
+} Kit_ThumbnailCache;
+
+void Kit_FreeThumbnailCache(void *ptr) {
+    Kit_ThumbnailCache *cache = ptr;
+    if(cache == NULL) return;
+    for(int i = 0; i < KIT_THUMBNAIL_CACHE_SIZE; i++) {
+        if(cache->entries[i].surface != NULL) {
+            SDL_FreeSurface(cache->entries[i].surface);
+        }
+    }
+    avformat_close_input(&cache->format_ctx);
+    free(cache);
+}
+
+static Kit_ThumbnailCache* _CreateThumbnailCache(const Kit_Source *src) {
+    AVFormatContext *src_ctx = (AVFormatContext *)src->format_ctx;
+    if(src->is_live) {
+        Kit_SetError("Thumbnails can't be extracted from live sources");
+        return NULL;
+    }
+    if(src->vstream_idx < 0) {
+        Kit_SetError("Source has no video stream");
+        return NULL;
+    }
+    if(src_ctx->filename[0] == '\0') {
+        Kit_SetError("Thumbnails need a source that was opened from an url");
+        return NULL;
+    }
+
+    Kit_ThumbnailCache *cache = calloc(1, sizeof(Kit_ThumbnailCache));
+    if(cache == NULL) {
+        Kit_SetError("Unable to allocate thumbnail cache");
+        return NULL;
+    }
+    if(avformat_open_input(&cache->format_ctx, src_ctx->filename, src_ctx->iformat, NULL) < 0) {
+        Kit_SetError("Unable to open source Url");
+        goto exit_0;
+    }
+    if(avformat_find_stream_info(cache->format_ctx, NULL) < 0) {
+        Kit_SetError("Unable to fetch source information");
+        goto exit_0;
+    }
+    if(src->vstream_idx >= (int)cache->format_ctx->nb_streams) {
+        Kit_SetError("Invalid video stream index: %d", src->vstream_idx);
+        goto exit_0;
+    }
+
+    // Only the video stream is ever needed
+    cache->stream_idx = src->vstream_idx;
+    for(unsigned int i = 0; i < cache->format_ctx->nb_streams; i++) {
+        cache->format_ctx->streams[i]->discard = ((int)i == cache->stream_idx) ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    }
+    return cache;
+
+exit_0:
+    Kit_FreeThumbnailCache(cache);
+    return NULL;
+}
+
+static Kit_ThumbnailEntry* _FindThumbnail(Kit_ThumbnailCache *cache, int64_t pos, int width, int height) {
+    for(int i = 0; i < KIT_THUMBNAIL_CACHE_SIZE; i++) {
+        Kit_ThumbnailEntry *entry = &cache->entries[i];
+        if(entry->last_used > 0 && entry->pos == pos && entry->width == width && entry->height == height) {
+            entry->last_used = ++cache->clock;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Takes ownership of the surface
+static void _StoreThumbnail(Kit_ThumbnailCache *cache, int64_t pos, int width, int height, SDL_Surface *surface) {
+    // Use an empty slot if there is one, otherwise evict the least recently used thumbnail
+    Kit_ThumbnailEntry *entry = &cache->entries[0];
+    for(int i = 1; i < KIT_THUMBNAIL_CACHE_SIZE && entry->last_used > 0; i++) {
+        if(cache->entries[i].last_used < entry->last_used) {
+            entry = &cache->entries[i];
+        }
+    }
+    if(entry->surface != NULL) {
+        SDL_FreeSurface(entry->surface);
+    }
+    entry->pos = pos;
+    entry->width = width;
+    entry->height = height;
+    entry->surface = surface;
+    entry->last_used = ++cache->clock;
+}
+
+// Resolves the keyframe at or before the requested time from an index, without any IO. Gives the
+// timestamp to seek to, and the byte position that identifies the keyframe whichever index found it.
+// The source's own keyframe index is preferred; the demuxer's index is used otherwise.
+static int _ResolveKeyframe(const Kit_Source *src, Kit_ThumbnailCache *cache, double time, int64_t *ts, int64_t *pos) {
+    AVStream *stream = cache->format_ctx->streams[cache->stream_idx];
+    const Kit_KeyframeIndex *index = src->keyframe_index;
+    if(index != NULL && index->stream_idx == cache->stream_idx) {
+        int i = Kit_FindKeyframe(index, time);
+        if(i >= 0) {
+            *ts = index->pts[i];
+            *pos = index->pos[i];
+            return 0;
+        }
+    }
+
+    int64_t target = av_rescale_q(time * AV_TIME_BASE, AV_TIME_BASE_Q, stream->time_base);
+    if(stream->start_time != AV_NOPTS_VALUE) {
+        target += stream->start_time;
+    }
+    int i = av_index_search_timestamp(stream, target, AVSEEK_FLAG_BACKWARD);
+    if(i < 0) {
+        i = av_index_search_timestamp(stream, target, 0);
+    }
+    if(i < 0) {
+        return 1;
+    }
+    *ts = stream->index_entries[i].timestamp;
+    *pos = stream->index_entries[i].pos;
+    return (*pos < 0);
+}
+
+// Reads up to the first keyframe packet of the video stream
+static int _ReadKeyframePacket(Kit_ThumbnailCache *cache, AVPacket *packet) {
+    for(int i = 0; i < KIT_THUMBNAIL_MAX_PACKETS; i++) {
+        if(av_read_frame(cache->format_ctx, packet) < 0) {
+            return 1;
+        }
+        if(packet->stream_index == cache->stream_idx && (packet->flags & AV_PKT_FLAG_KEY)) {
+            return 0;
+        }
+        av_packet_unref(packet);
+    }
+    return 1;
+}
+
+static SDL_Surface* _DecodeThumbnail(Kit_ThumbnailCache *cache, AVPacket *packet, int width, int height) {
+    AVStream *stream = cache->format_ctx->streams[cache->stream_idx];
+    AVCodecContext *codec_ctx = NULL;
+    AVFrame *frame = NULL;
+    SDL_Surface *surface = NULL;
+    int frame_finished = 0;
+
+    AVCodec *codec = avcodec_find_decoder(stream->codec->codec_id);
+    if(!codec) {
+        Kit_SetError("No suitable video decoder found");
+        return NULL;
+    }
+    codec_ctx = avcodec_alloc_context3(codec);
+    if(codec_ctx == NULL || avcodec_copy_context(codec_ctx, stream->codec) != 0) {
+        Kit_SetError("Unable to copy video codec context");
+        goto exit_0;
+    }
+
+    // Let the decoder skip resolution it would only throw away, where the codec supports it.
+    // Only the keyframe is wanted, so nothing else needs to be decoded either.
+    while(codec_ctx->lowres < codec->max_lowres
+        && (codec_ctx->width >> (codec_ctx->lowres + 1)) >= width
+        && (codec_ctx->height >> (codec_ctx->lowres + 1)) >= height)
+    {
+        codec_ctx->lowres++;
+    }
+    codec_ctx->skip_frame = AVDISCARD_NONKEY;
+    if(avcodec_open2(codec_ctx, codec, NULL) < 0) {
+        Kit_SetError("Unable to allocate video codec context");
+        goto exit_0;
+    }
+
+    frame = av_frame_alloc();
+    if(frame == NULL) {
+        Kit_SetError("Unable to allocate video frame");
+        goto exit_1;
+    }
+
+    // Feed packets until the keyframe comes out. Decoders with delay may need a few more
+    // packets, or a flush at the end of the stream.
+    AVPacket next;
+    av_init_packet(&next);
+    int read_ok = 1;
+    for(int i = 0; i < KIT_THUMBNAIL_MAX_PACKETS && !frame_finished; i++) {
+        if(avcodec_decode_video2(codec_ctx, frame, &frame_finished, packet) < 0) {
+            break;
+        }
+        if(frame_finished || !read_ok) {
+            break;
+        }
+        do {
+            av_packet_unref(&next);
+            read_ok = (av_read_frame(cache->format_ctx, &next) >= 0);
+        } while(read_ok && next.stream_index != cache->stream_idx);
+        if(read_ok) {
+            packet = &next;
+        } else {
+            next.data = NULL;
+            next.size = 0;
+            packet = &next;
+        }
+    }
+    av_packet_unref(&next);
+    if(!frame_finished) {
+        Kit_SetError("Unable to decode thumbnail frame");
+        goto exit_2;
+    }
+
+    // Scale straight into the output surface. Same byte order as SDL_PIXELFORMAT_ABGR8888.
+    Uint32 rmask, gmask, bmask, amask;
+    #if SDL_BYTEORDER == SDL_BIG_ENDIAN
+        rmask = 0xff000000;
+        gmask = 0x00ff0000;
+        bmask = 0x0000ff00;
+        amask = 0x000000ff;
+    #else
+        rmask = 0x000000ff;
+        gmask = 0x0000ff00;
+        bmask = 0x00ff0000;
+        amask = 0xff000000;
+    #endif
+    surface = SDL_CreateRGBSurface(0, width, height, 32, rmask, gmask, bmask, amask);
+    if(surface == NULL) {
+        Kit_SetError("Unable to allocate thumbnail surface: %s", SDL_GetError());
+        goto exit_2;
+    }
+    struct SwsContext *sws = sws_getContext(
+        frame->width, frame->height, (enum AVPixelFormat)frame->format,
+        width, height, AV_PIX_FMT_RGBA,
+        SWS_BILINEAR, NULL, NULL, NULL);
+    if(sws == NULL) {
+        Kit_SetError("Unable to initialize thumbnail scaler");
+        SDL_FreeSurface(surface);
+        surface = NULL;
+        goto exit_2;
+    }
+    unsigned char *dst_data[4] = { surface->pixels, NULL, NULL, NULL };
+    int dst_linesize[4] = { surface->pitch, 0, 0, 0 };
+    sws_scale(sws, (const unsigned char * const *)frame->data, frame->linesize, 0, frame->height, dst_data, dst_linesize);
+    sws_freeContext(sws);
+
+exit_2:
+    av_frame_free(&frame);
+exit_1:
+    avcodec_close(codec_ctx);
+exit_0:
+    avcodec_free_context(&codec_ctx);
+    return surface;
+}
+
+SDL_Surface* Kit_ExtractThumbnail(Kit_Source *src, double time, int width, int height) {
+    assert(src != NULL);
+    AVPacket packet;
+
+    if(src->thumb_cache == NULL) {
+        src->thumb_cache = _CreateThumbnailCache(src);
+        if(src->thumb_cache == NULL) {
+            return NULL;
+        }
+    }
+    Kit_ThumbnailCache *cache = src->thumb_cache;
+    AVStream *stream = cache->format_ctx->streams[cache->stream_idx];
+
+    // Missing dimensions follow the aspect ratio of the video
+    int video_w = stream->codec->width;
+    int video_h = stream->codec->height;
+    if(video_w <= 0 || video_h <= 0) {
+        Kit_SetError("Unknown video dimensions");
+        return NULL;
+    }
+    if(width <= 0 && height <= 0) {
+        width = video_w;
+        height = video_h;
+    } else if(width <= 0) {
+        width = (int64_t)height * video_w / video_h;
+    } else if(height <= 0) {
+        height = (int64_t)width * video_h / video_w;
+    }
+    if(width <= 0 || height <= 0) {
+        Kit_SetError("Invalid thumbnail size %dx%d", width, height);
+        return NULL;
+    }
+
+    // Find the keyframe at or before the requested time, so that every time between two keyframes
+    // shares one thumbnail. Thumbnails are keyed on the keyframe's byte position. If an index knows
+    // the keyframe, a cached thumbnail is returned without touching the demuxer at all; otherwise
+    // the keyframe packet header has to be read first.
+    int64_t ts, pos;
+    Kit_ThumbnailEntry *entry = NULL;
+    bool resolved = (_ResolveKeyframe(src, cache, time, &ts, &pos) == 0);
+    if(resolved) {
+        entry = _FindThumbnail(cache, pos, width, height);
+    }
+    if(entry != NULL) {
+        cache->hits++;
+    } else {
+        av_init_packet(&packet);
+        if(resolved) {
+            if(avformat_seek_file(cache->format_ctx, cache->stream_idx, INT64_MIN, ts, ts, 0) < 0) {
+                Kit_SetError("Unable to seek to %f", time);
+                return NULL;
+            }
+        } else {
+            int64_t seek_target = time * AV_TIME_BASE;
+            if(avformat_seek_file(cache->format_ctx, -1, INT64_MIN, seek_target, seek_target, 0) < 0) {
+                if(avformat_seek_file(cache->format_ctx, -1, INT64_MIN, seek_target, INT64_MAX, 0) < 0) {
+                    Kit_SetError("Unable to seek to %f", time);
+                    return NULL;
+                }
+            }
+        }
+        if(_ReadKeyframePacket(cache, &packet) != 0) {
+            Kit_SetError("No keyframe found near %f", time);
+            return NULL;
+        }
+        if(!resolved) {
+            pos = packet.pos;
+            entry = _FindThumbnail(cache, pos, width, height);
+        }
+        if(entry != NULL) {
+            cache->hits++;
+        } else {
+            cache->misses++;
+            SDL_Surface *surface = _DecodeThumbnail(cache, &packet, width, height);
+            av_packet_unref(&packet);
+            if(surface == NULL) {
+                return NULL;
+            }
+            if(pos < 0) {
+                // Nothing to key the thumbnail on, so it can't be cached
+                return surface;
+            }
+            _StoreThumbnail(cache, pos, width, height, surface);
+            entry = _FindThumbnail(cache, pos, width, height);
+        }
+        av_packet_unref(&packet);
+    }
+
+    // Hand out a copy, so that the cache can evict freely
+    SDL_Surface *out = SDL_ConvertSurface(entry->surface, entry->surface->format, 0);
+    if(out == NULL) {
+        Kit_SetError("Unable to copy thumbnail: %s", SDL_GetError());
+    }
+    return out;
+}
+
+void Kit_GetThumbnailCacheStats(const Kit_Source *src, unsigned int *hits, unsigned int *misses) {
+    assert(src != NULL);
+    const Kit_ThumbnailCache *cache = src->thumb_cache;
+    if(hits != NULL) {
+        *hits = (cache != NULL) ? cache->hits : 0;
+    }
+    if(misses != NULL) {
+        *misses = (cache != NULL) ? cache->misses : 0;
+    }
+}
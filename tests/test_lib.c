@@ -3,6 +3,7 @@
 #include "kitchensink/kitchensink.h"
 
 void source_test_suite(CU_pSuite suite);
+void player_test_suite(CU_pSuite suite);
 
 int main(int argc, char **argv) {
     CU_pSuite suite = NULL;
@@ -17,6 +18,10 @@ int main(int argc, char **argv) {
     if(suite == NULL) goto end;
     source_test_suite(suite);
 
+    suite = CU_add_suite("Player functions", NULL, NULL);
+    if(suite == NULL) goto end;
+    player_test_suite(suite);
+
     // Run tests
     CU_basic_set_mode(CU_BRM_VERBOSE);
     CU_basic_run_tests();
@@ -0,0 +1,519 @@
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <kitchensink/kitchensink.h>
+#include <kitchensink/internal/kitbuffer.h>
+#include <kitchensink/internal/kitpacketbuffer.h>
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <SDL2/SDL_render.h>
+#include <SDL2/SDL_timer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_FILE "../../tests/data/CEP140_512kb.mp4"
+
+// Writes a 100 byte packet to the window; its pts in milliseconds is kept in the packet too
+static int write_packet(Kit_PacketBuffer *buffer, double pts, bool is_anchor) {
+    AVPacket packet;
+    if(av_new_packet(&packet, 100) != 0) {
+        return 1;
+    }
+    packet.pts = pts * 1000;
+    int ret = Kit_WritePacketBuffer(buffer, &packet, pts, is_anchor);
+    av_packet_unref(&packet);
+    return ret;
+}
+
+// Reads the next replayed packet, and gives its pts in milliseconds. -1 when replay has ended.
+static int64_t read_packet(Kit_PacketBuffer *buffer) {
+    AVPacket packet;
+    av_init_packet(&packet);
+    if(Kit_ReadPacketBuffer(buffer, &packet) != 0) {
+        return -1;
+    }
+    int64_t pts = packet.pts;
+    av_packet_unref(&packet);
+    return pts;
+}
+
+void test_Kit_PacketBufferWrite(void) {
+    Kit_PacketBuffer *buffer = Kit_CreatePacketBuffer(0, 0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(buffer);
+    CU_ASSERT(buffer->cursor == -1);
+
+    // Enough packets to grow past the initial capacity; nothing is dropped without limits
+    for(int i = 0; i < 3000; i++) {
+        CU_ASSERT(write_packet(buffer, i * 0.04, i % 25 == 0) == 0);
+    }
+    CU_ASSERT(buffer->count == 3000);
+    CU_ASSERT(buffer->bytes == 3000 * 100);
+    CU_ASSERT(buffer->packets[buffer->head].pts == 0.0);
+
+    Kit_ClearPacketBuffer(buffer);
+    CU_ASSERT(buffer->count == 0);
+    CU_ASSERT(buffer->bytes == 0);
+    CU_ASSERT(Kit_SeekPacketBuffer(buffer, 0.0) == 1);
+    Kit_DestroyPacketBuffer(buffer);
+}
+
+void test_Kit_PacketBufferEvict(void) {
+    // Time span limit
+    Kit_PacketBuffer *buffer = Kit_CreatePacketBuffer(2.0, 0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(buffer);
+    for(int i = 0; i <= 8; i++) {
+        CU_ASSERT(write_packet(buffer, i * 0.5, i % 2 == 0) == 0);
+    }
+    CU_ASSERT(buffer->count == 5);
+    CU_ASSERT(buffer->packets[buffer->head].pts == 2.0);
+    CU_ASSERT(buffer->bytes == 5 * 100);
+    Kit_DestroyPacketBuffer(buffer);
+
+    // Size limit
+    buffer = Kit_CreatePacketBuffer(0, 1000);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(buffer);
+    for(int i = 0; i < 50; i++) {
+        CU_ASSERT(write_packet(buffer, i * 0.5, true) == 0);
+    }
+    CU_ASSERT(buffer->count == 10);
+    CU_ASSERT(buffer->bytes == 1000);
+    CU_ASSERT(buffer->packets[buffer->head].pts == 20.0);
+    Kit_DestroyPacketBuffer(buffer);
+}
+
+void test_Kit_PacketBufferSeek(void) {
+    Kit_PacketBuffer *buffer = Kit_CreatePacketBuffer(2.0, 0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(buffer);
+    CU_ASSERT(Kit_SeekPacketBuffer(buffer, 0.0) == 1);
+    for(int i = 0; i <= 8; i++) {
+        CU_ASSERT(write_packet(buffer, i * 0.5, i % 2 == 0) == 0);
+    }
+
+    // Window is 2.0 - 4.0 with anchors at full seconds
+    CU_ASSERT(Kit_SeekPacketBuffer(buffer, 1.0) == 1);
+    CU_ASSERT(Kit_SeekPacketBuffer(buffer, 4.5) == 1);
+    CU_ASSERT(buffer->cursor == -1);
+    CU_ASSERT(Kit_SeekPacketBuffer(buffer, 3.7) == 0);
+    CU_ASSERT(buffer->packets[buffer->cursor].pts == 3.0);
+    CU_ASSERT(Kit_SeekPacketBuffer(buffer, 2.0) == 0);
+    CU_ASSERT(buffer->packets[buffer->cursor].pts == 2.0);
+    Kit_DestroyPacketBuffer(buffer);
+}
+
+void test_Kit_PacketBufferReplay(void) {
+    Kit_PacketBuffer *buffer = Kit_CreatePacketBuffer(2.0, 0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(buffer);
+    for(int i = 0; i <= 8; i++) {
+        CU_ASSERT(write_packet(buffer, i * 0.5, i % 2 == 0) == 0);
+    }
+    CU_ASSERT(read_packet(buffer) == -1);
+
+    // Replay runs from the anchor up to the live edge, and then ends
+    CU_ASSERT(Kit_SeekPacketBuffer(buffer, 3.2) == 0);
+    CU_ASSERT(read_packet(buffer) == 3000);
+    CU_ASSERT(read_packet(buffer) == 3500);
+    CU_ASSERT(read_packet(buffer) == 4000);
+    CU_ASSERT(read_packet(buffer) == -1);
+    CU_ASSERT(buffer->cursor == -1);
+
+    // Packets waiting for replay outlive the limits, even as new ones keep coming in
+    CU_ASSERT(Kit_SeekPacketBuffer(buffer, 2.0) == 0);
+    for(int i = 9; i <= 16; i++) {
+        CU_ASSERT(write_packet(buffer, i * 0.5, i % 2 == 0) == 0);
+    }
+    CU_ASSERT(buffer->packets[buffer->head].pts == 2.0);
+    for(int i = 4; i <= 16; i++) {
+        CU_ASSERT(read_packet(buffer) == i * 500);
+    }
+    CU_ASSERT(read_packet(buffer) == -1);
+
+    // Once replay has caught up, the window is trimmed back down with the next write
+    CU_ASSERT(write_packet(buffer, 8.5, false) == 0);
+    CU_ASSERT(buffer->packets[buffer->head].pts >= 6.5);
+    Kit_DestroyPacketBuffer(buffer);
+}
+
+// Source with only the audio stream enabled. Audio is the master clock, so it can be pulled
+// as fast as the decoder keeps up, with no video output that would need to be consumed too.
+static Kit_Source* open_audio_source(void) {
+    Kit_Source *source = Kit_CreateSourceFromUrl(TEST_FILE);
+    if(source != NULL) {
+        Kit_SetSourceStream(source, KIT_STREAMTYPE_VIDEO, -1);
+        Kit_SetSourceStream(source, KIT_STREAMTYPE_SUBTITLE, -1);
+    }
+    return source;
+}
+
+// Pulls the given amount of stream time worth of audio, or stops at end of stream or timeout
+static double pull_audio(Kit_Player *player, double seconds) {
+    unsigned char buf[4096];
+    const Kit_AudioFormat *fmt = &player->aformat;
+    double bps = fmt->bytes * fmt->channels * fmt->samplerate;
+    double pulled = 0;
+    Uint32 start = SDL_GetTicks();
+    while(pulled < seconds && SDL_GetTicks() - start < 5000) {
+        if(Kit_GetPlayerState(player) == KIT_STOPPED) {
+            break;
+        }
+        int got = Kit_GetAudioData(player, buf, sizeof(buf), 0);
+        if(got <= 0) {
+            SDL_Delay(1);
+            continue;
+        }
+        pulled += got / bps;
+    }
+    return pulled;
+}
+
+// Stream time of the audio last handed out, mapped back into the loop segment. The player
+// position follows the video clock, which doesn't move for audio only sources.
+static double audio_loop_pos(const Kit_Player *player, double start, double end) {
+    double pos = player->aclock_pos - player->item_offset;
+    while(pos >= end) {
+        pos -= end - start;
+    }
+    return pos;
+}
+
+void test_Kit_PlayerLoopSegment(void) {
+    Kit_Source *source = open_audio_source();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(source);
+    Kit_Player *player = Kit_CreatePlayer(source);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(player);
+
+    CU_ASSERT(Kit_SetPlayerLoopSegment(player, 2.0, 1.0) == 1);
+    CU_ASSERT(Kit_SetPlayerLoopSegment(player, -1.0, 1.0) == 1);
+    CU_ASSERT(Kit_SetPlayerLoopCacheSize(player, -1) == 1);
+    CU_ASSERT(!Kit_IsPlayerLoopCached(player));
+
+    // First pass is recorded, and the passes after it are replayed from memory
+    CU_ASSERT(Kit_SetPlayerLoopSegment(player, 1.0, 1.5) == 0);
+    Kit_PlayerPlay(player);
+    Uint32 start = SDL_GetTicks();
+    while(!Kit_IsPlayerLoopCached(player) && SDL_GetTicks() - start < 5000) {
+        pull_audio(player, 0.1);
+    }
+    CU_ASSERT(Kit_IsPlayerLoopCached(player));
+    double offset = player->loop_offset;
+    CU_ASSERT(pull_audio(player, 1.5) >= 1.5);
+    CU_ASSERT(player->loop_offset >= offset + 1.0);
+    double pos = audio_loop_pos(player, 1.0, 1.5);
+    CU_ASSERT(pos >= 1.0 && pos < 1.5);
+
+    CU_ASSERT(Kit_ClearPlayerLoopSegment(player) == 0);
+    CU_ASSERT(!Kit_IsPlayerLoopCached(player));
+
+    // Without room for the segment, every pass is demuxed again and playback goes on the same
+    CU_ASSERT(Kit_SetPlayerLoopCacheSize(player, 0) == 0);
+    CU_ASSERT(Kit_SetPlayerLoopSegment(player, 1.0, 1.5) == 0);
+    CU_ASSERT(pull_audio(player, 2.0) >= 2.0);
+    CU_ASSERT(!Kit_IsPlayerLoopCached(player));
+    CU_ASSERT(player->loop_offset >= 1.0);
+    pos = audio_loop_pos(player, 1.0, 1.5);
+    CU_ASSERT(pos >= 1.0 && pos < 1.5);
+
+    Kit_ClosePlayer(player);
+    Kit_CloseSource(source);
+}
+
+// Starts playback a second before the end of the source, so that it runs out quickly
+static void play_near_end(Kit_Player *player) {
+    double duration = Kit_GetPlayerDuration(player);
+    CU_ASSERT(duration > 2.0);
+    CU_ASSERT(Kit_PlayerSeekTo(player, duration - 1.0) == 0);
+    Kit_PlayerPlay(player);
+}
+
+void test_Kit_PlayerQueueSource(void) {
+    Kit_Source *first = open_audio_source();
+    Kit_Source *second = open_audio_source();
+    Kit_Source *silent = Kit_CreateSourceFromUrl(TEST_FILE);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(first);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(second);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(silent);
+    Kit_SetSourceStream(silent, KIT_STREAMTYPE_AUDIO, -1);
+
+    // Without anything queued, playback stops at the end of the source
+    Kit_Player *player = Kit_CreatePlayer(first);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(player);
+    play_near_end(player);
+    CU_ASSERT(pull_audio(player, 3.0) < 3.0);
+    CU_ASSERT(Kit_GetPlayerState(player) == KIT_STOPPED);
+    Kit_ClosePlayer(player);
+
+    // Queued source takes over without a gap. It needs the same kinds of streams.
+    player = Kit_CreatePlayer(first);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(player);
+    CU_ASSERT(Kit_QueuePlayerSource(player, silent) == 1);
+    CU_ASSERT(Kit_QueuePlayerSource(player, second) == 0);
+    play_near_end(player);
+    CU_ASSERT(pull_audio(player, 3.0) >= 3.0);
+    CU_ASSERT(Kit_GetPlayerState(player) == KIT_PLAYING);
+    CU_ASSERT(player->src == second);
+    CU_ASSERT(Kit_GetPlayerDuration(player) > 2.0);
+    Kit_ClosePlayer(player);
+
+    Kit_CloseSource(silent);
+    Kit_CloseSource(second);
+    Kit_CloseSource(first);
+}
+
+void test_Kit_PlayerLooping(void) {
+    Kit_Source *source = open_audio_source();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(source);
+    Kit_Player *player = Kit_CreatePlayer(source);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(player);
+
+    CU_ASSERT(!Kit_IsPlayerLooping(player));
+    Kit_SetPlayerLooping(player, true);
+    CU_ASSERT(Kit_IsPlayerLooping(player));
+
+    // Playback wraps around to the start of the file, and keeps going
+    play_near_end(player);
+    CU_ASSERT(pull_audio(player, 3.0) >= 3.0);
+    CU_ASSERT(Kit_GetPlayerState(player) == KIT_PLAYING);
+    CU_ASSERT(player->src == source);
+
+    // Once looping is turned off, the next end stops playback
+    Kit_SetPlayerLooping(player, false);
+    CU_ASSERT(Kit_PlayerSeekTo(player, Kit_GetPlayerDuration(player) - 1.0) == 0);
+    pull_audio(player, 30.0);
+    CU_ASSERT(Kit_GetPlayerState(player) == KIT_STOPPED);
+
+    Kit_ClosePlayer(player);
+    Kit_CloseSource(source);
+}
+
+// Source with only the video stream enabled. Without audio, the clock follows system time.
+static Kit_Source* open_video_source(void) {
+    Kit_Source *source = Kit_CreateSourceFromUrl(TEST_FILE);
+    if(source != NULL) {
+        Kit_SetSourceStream(source, KIT_STREAMTYPE_AUDIO, -1);
+        Kit_SetSourceStream(source, KIT_STREAMTYPE_SUBTITLE, -1);
+    }
+    return source;
+}
+
+// Finds the pts of the first non-keyframe video packet at or after the given time, so that
+// getting there takes decoding forwards from an earlier keyframe. Returns -1 if none is found.
+static double find_frame_pts(double after) {
+    AVFormatContext *fmt_ctx = NULL;
+    if(avformat_open_input(&fmt_ctx, TEST_FILE, NULL, NULL) != 0) {
+        return -1;
+    }
+    double found = -1;
+    int idx = -1;
+    if(avformat_find_stream_info(fmt_ctx, NULL) >= 0) {
+        idx = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    }
+    AVPacket packet;
+    while(idx >= 0 && found < 0 && av_read_frame(fmt_ctx, &packet) >= 0) {
+        if(packet.stream_index == idx && !(packet.flags & AV_PKT_FLAG_KEY) && packet.pts != AV_NOPTS_VALUE) {
+            double pts = packet.pts * av_q2d(fmt_ctx->streams[idx]->time_base);
+            if(pts >= after) {
+                found = pts;
+            }
+        }
+        av_packet_unref(&packet);
+    }
+    avformat_close_input(&fmt_ctx);
+    return found;
+}
+
+// Waits until the decoder thread has picked up the queued seek, and handed out the first data after it
+static bool wait_seek(Kit_Player *player) {
+    Uint32 start = SDL_GetTicks();
+    while(SDL_GetTicks() - start < 5000) {
+        bool done = false;
+        if(SDL_LockMutex(player->cmutex) == 0) {
+            done = (Kit_PeekBuffer((Kit_Buffer*)player->cbuffer) == NULL && player->seek_flag == 0);
+            SDL_UnlockMutex(player->cmutex);
+        }
+        if(done) {
+            return true;
+        }
+        SDL_Delay(1);
+    }
+    return false;
+}
+
+void test_Kit_PlayerExactSeek(void) {
+    double target = find_frame_pts(5.0);
+    CU_ASSERT_FATAL(target >= 5.0);
+    Kit_Source *source = open_video_source();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(source);
+    Kit_Player *player = Kit_CreatePlayer(source);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(player);
+
+    // Frames before the target are decoded but dropped, and the first one handed out is at it
+    Kit_SetPlayerSeekMode(player, KIT_SEEK_EXACT);
+    CU_ASSERT(Kit_PlayerSeekTo(player, target) == 0);
+    Kit_PlayerPlay(player);
+    CU_ASSERT(wait_seek(player));
+    CU_ASSERT_DOUBLE_EQUAL(Kit_GetPlayerPosition(player), target, 0.001);
+    CU_ASSERT(Kit_GetPlayerSeekTime(player) > 0);
+
+    Kit_ClosePlayer(player);
+    Kit_CloseSource(source);
+}
+
+void test_Kit_PlayerScrubbing(void) {
+    double target = find_frame_pts(6.0);
+    CU_ASSERT_FATAL(target >= 6.0);
+    Kit_Source *source = Kit_CreateSourceFromUrl(TEST_FILE);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(source);
+    Kit_Player *player = Kit_CreatePlayer(source);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(player);
+    AVFormatContext *fmt_ctx = (AVFormatContext*)source->format_ctx;
+    AVStream *astream = fmt_ctx->streams[source->astream_idx];
+    Kit_SetPlayerSeekMode(player, KIT_SEEK_EXACT);
+    CU_ASSERT(Kit_SetPlayerDvrWindow(player, 30.0, 0) == 0);
+
+    Kit_SetPlayerScrubbing(player, true);
+    Kit_PlayerPlay(player);
+    Uint32 start = SDL_GetTicks();
+    while(!player->dec_scrubbing && SDL_GetTicks() - start < 5000) {
+        SDL_Delay(1);
+    }
+    CU_ASSERT_FATAL(player->dec_scrubbing);
+
+    // Scrubbing only lands on keyframes, doesn't demux audio, and keeps nothing in the window
+    CU_ASSERT(Kit_PlayerSeekTo(player, target) == 0);
+    CU_ASSERT(wait_seek(player));
+    double pos = Kit_GetPlayerPosition(player);
+    CU_ASSERT(pos < target - 0.001 || pos > target + 0.001);
+    CU_ASSERT(astream->discard == AVDISCARD_ALL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(player->dvr);
+    CU_ASSERT(((Kit_PacketBuffer*)player->dvr)->count == 0);
+
+    // Once it ends, playback restarts from the last scrubbed position with everything decoded
+    Kit_SetPlayerScrubbing(player, false);
+    start = SDL_GetTicks();
+    do {
+        SDL_Delay(1);
+        pos = Kit_GetPlayerPosition(player);
+    } while((pos < target - 0.001 || pos > target + 0.001) && SDL_GetTicks() - start < 5000);
+    CU_ASSERT_DOUBLE_EQUAL(pos, target, 0.001);
+    CU_ASSERT(!player->dec_scrubbing);
+    CU_ASSERT(player->seek_pos == target);
+    CU_ASSERT(astream->discard == AVDISCARD_DEFAULT);
+    CU_ASSERT(((AVCodecContext*)player->vcodec_ctx)->skip_frame == AVDISCARD_DEFAULT);
+    CU_ASSERT(((Kit_PacketBuffer*)player->dvr)->count > 0);
+
+    Kit_ClosePlayer(player);
+    Kit_CloseSource(source);
+}
+
+void test_Kit_PlayerSeekCoalescing(void) {
+    Kit_Source *source = open_video_source();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(source);
+    Kit_Player *player = Kit_CreatePlayer(source);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(player);
+    Kit_Buffer *cbuffer = (Kit_Buffer*)player->cbuffer;
+
+    // The decoder thread leaves the control queue alone while stopped. Only the latest seek
+    // is kept, so there is always room for more, way past the queue size.
+    for(int i = 1; i <= 20; i++) {
+        CU_ASSERT(Kit_PlayerSeekTo(player, i * 0.25) == 0);
+    }
+    CU_ASSERT(cbuffer->write_p - cbuffer->read_p == 2);
+    CU_ASSERT(player->seek_request == 5.0);
+
+    // Relative seeks start from the pending target, not the position on screen
+    CU_ASSERT(Kit_PlayerSeek(player, 2.0) == 0);
+    CU_ASSERT(Kit_PlayerSeek(player, -1.0) == 0);
+    CU_ASSERT(cbuffer->write_p - cbuffer->read_p == 2);
+    CU_ASSERT(player->seek_request == 6.0);
+
+    Kit_PlayerPlay(player);
+    CU_ASSERT(wait_seek(player));
+    CU_ASSERT(player->seek_pos == 6.0);
+
+    Kit_ClosePlayer(player);
+    Kit_CloseSource(source);
+}
+
+// Oldest frame waiting in the video buffer, or NULL if there is none
+static void* peek_video(Kit_Player *player) {
+    void *packet = NULL;
+    if(SDL_LockMutex(player->vmutex) == 0) {
+        packet = Kit_PeekBuffer((Kit_Buffer*)player->vbuffer);
+        SDL_UnlockMutex(player->vmutex);
+    }
+    return packet;
+}
+
+void test_Kit_PlayerPausedSeek(void) {
+    double target = find_frame_pts(5.0);
+    CU_ASSERT_FATAL(target >= 5.0);
+    Kit_Source *source = open_video_source();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(source);
+    Kit_Player *player = Kit_CreatePlayer(source);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(player);
+
+    // Software renderer needs no window, so this runs headless
+    SDL_Surface *surface = SDL_CreateRGBSurface(0, player->vformat.width, player->vformat.height, 32, 0, 0, 0, 0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(surface);
+    SDL_Renderer *renderer = SDL_CreateSoftwareRenderer(surface);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(renderer);
+    SDL_Texture *texture = SDL_CreateTexture(
+        renderer, player->vformat.format, SDL_TEXTUREACCESS_STATIC,
+        player->vformat.width, player->vformat.height);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(texture);
+
+    Kit_SetPlayerSeekMode(player, KIT_SEEK_EXACT);
+    Kit_PlayerPlay(player);
+    Kit_PlayerPause(player);
+    CU_ASSERT(Kit_PlayerSeekTo(player, target) == 0);
+    CU_ASSERT(wait_seek(player));
+
+    // Decoding goes on while paused; let it fill the video buffer so that frames are waiting
+    Uint32 start = SDL_GetTicks();
+    int full = 0;
+    while(full == 0 && SDL_GetTicks() - start < 5000) {
+        if(SDL_LockMutex(player->vmutex) == 0) {
+            full = Kit_IsBufferFull((Kit_Buffer*)player->vbuffer);
+            SDL_UnlockMutex(player->vmutex);
+        }
+        SDL_Delay(1);
+    }
+    CU_ASSERT_FATAL(full == 1);
+
+    // The frame at the seek target is handed out even though the player is paused
+    void *first = peek_video(player);
+    CU_ASSERT(player->preview_flag);
+    CU_ASSERT(Kit_GetVideoData(player, texture) == 0);
+    CU_ASSERT(!player->preview_flag);
+    CU_ASSERT_DOUBLE_EQUAL(Kit_GetPlayerPosition(player), target, 0.001);
+    void *next = peek_video(player);
+    CU_ASSERT_PTR_NOT_NULL(next);
+    CU_ASSERT(next != first);
+
+    // ... but only that one; the frames after it wait for playback to resume
+    for(int i = 0; i < 10; i++) {
+        CU_ASSERT(Kit_GetVideoData(player, texture) == 0);
+        SDL_Delay(10);
+    }
+    CU_ASSERT(peek_video(player) == next);
+    CU_ASSERT_DOUBLE_EQUAL(Kit_GetPlayerPosition(player), target, 0.001);
+
+    Kit_ClosePlayer(player);
+    Kit_CloseSource(source);
+    SDL_DestroyTexture(texture);
+    SDL_DestroyRenderer(renderer);
+    SDL_FreeSurface(surface);
+}
+
+void player_test_suite(CU_pSuite suite) {
+    if(CU_add_test(suite, "Kit_PacketBufferWrite", test_Kit_PacketBufferWrite) == NULL) { return; }
+    if(CU_add_test(suite, "Kit_PacketBufferEvict", test_Kit_PacketBufferEvict) == NULL) { return; }
+    if(CU_add_test(suite, "Kit_PacketBufferSeek", test_Kit_PacketBufferSeek) == NULL) { return; }
+    if(CU_add_test(suite, "Kit_PacketBufferReplay", test_Kit_PacketBufferReplay) == NULL) { return; }
+    if(CU_add_test(suite, "Kit_PlayerLoopSegment", test_Kit_PlayerLoopSegment) == NULL) { return; }
+    if(CU_add_test(suite, "Kit_PlayerQueueSource", test_Kit_PlayerQueueSource) == NULL) { return; }
+    if(CU_add_test(suite, "Kit_PlayerLooping", test_Kit_PlayerLooping) == NULL) { return; }
+    if(CU_add_test(suite, "Kit_PlayerExactSeek", test_Kit_PlayerExactSeek) == NULL) { return; }
+    if(CU_add_test(suite, "Kit_PlayerScrubbing", test_Kit_PlayerScrubbing) == NULL) { return; }
+    if(CU_add_test(suite, "Kit_PlayerSeekCoalescing", test_Kit_PlayerSeekCoalescing) == NULL) { return; }
+    if(CU_add_test(suite, "Kit_PlayerPausedSeek", test_Kit_PlayerPausedSeek) == NULL) { return; }
+}
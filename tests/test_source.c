@@ -1,9 +1,76 @@
 #include <CUnit/CUnit.h>
 #include <CUnit/Basic.h>
 #include <kitchensink/kitchensink.h>
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <SDL2/SDL_timer.h>
+#include <SDL2/SDL_thread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+#define TEST_FILE "../../tests/data/CEP140_512kb.mp4"
 
 Kit_Source *src = NULL;
 
+static unsigned char *load_test_file(size_t *size) {
+    FILE *fp = fopen(TEST_FILE, "rb");
+    if(fp == NULL) {
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    *size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    unsigned char *data = malloc(*size);
+    if(data != NULL && fread(data, 1, *size, fp) != *size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(fp);
+    return data;
+}
+
+// Path for a scratch file in the system temp directory
+static void temp_path(char *out, size_t size, const char *name) {
+    const char *dir = getenv("TMPDIR");
+    if(dir == NULL) dir = getenv("TEMP");
+    if(dir == NULL) dir = "/tmp";
+    snprintf(out, size, "%s/%s", dir, name);
+}
+
+// Reads through the custom IO of the source at spots that cross block and window boundaries,
+// jumping back and forth, and checks every byte against the file itself.
+static void check_source_io(Kit_Source *source) {
+    static const int64_t offsets[] = {
+        0, 32768 - 10, 262144 - 100, 3 * 262144 + 5, 3000000, 1000, 1048576 - 1, 2 * 1048576 + 7, -50
+    };
+    unsigned char buf[4096];
+    size_t size;
+    unsigned char *data = load_test_file(&size);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(data);
+    AVIOContext *pb = source->avio_ctx;
+    CU_ASSERT_PTR_NOT_NULL_FATAL(pb);
+    CU_ASSERT(avio_size(pb) == (int64_t)size);
+
+    for(unsigned int i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+        int64_t offset = offsets[i] >= 0 ? offsets[i] : (int64_t)size + offsets[i];
+        int64_t want = (int64_t)size - offset < (int64_t)sizeof(buf) ? (int64_t)size - offset : (int64_t)sizeof(buf);
+        CU_ASSERT(avio_seek(pb, offset, SEEK_SET) == offset);
+        int got = avio_read(pb, buf, sizeof(buf));
+        CU_ASSERT(got == want);
+        if(got > 0) {
+            CU_ASSERT(memcmp(buf, data + offset, got) == 0);
+        }
+    }
+
+    // Reading on from the last spot hits the end of the stream
+    CU_ASSERT(avio_read(pb, buf, sizeof(buf)) <= 0);
+    CU_ASSERT(avio_feof(pb));
+    free(data);
+}
+
 void test_Kit_CreateSourceFromUrl(void) {
     CU_ASSERT_PTR_NULL(Kit_CreateSourceFromUrl("nonexistent"));
     src = Kit_CreateSourceFromUrl("../../tests/data/CEP140_512kb.mp4");
@@ -38,11 +105,591 @@ void test_Kit_CloseSource(void) {
     Kit_CloseSource(src);
 }
 
+void test_Kit_CreateSourceFromUrlWithOptions(void) {
+    Kit_SourceOptions opts;
+    Kit_InitSourceOptions(&opts);
+    opts.format = "nonexistent";
+    CU_ASSERT_PTR_NULL(Kit_CreateSourceFromUrlWithOptions("../../tests/data/CEP140_512kb.mp4", &opts));
+
+    opts.format = "mp4";
+    opts.probesize = 32768;
+    opts.analyzeduration = 100000;
+    opts.skip_stream_info = true;
+    Kit_Source *fast = Kit_CreateSourceFromUrlWithOptions("../../tests/data/CEP140_512kb.mp4", &opts);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fast);
+    CU_ASSERT(Kit_GetSourceStreamCount(fast) == 2);
+    CU_ASSERT(Kit_GetBestSourceStream(fast, KIT_STREAMTYPE_VIDEO) == 0);
+    CU_ASSERT(Kit_GetBestSourceStream(fast, KIT_STREAMTYPE_AUDIO) == 1);
+    Kit_CloseSource(fast);
+}
+
+// Removes the files a probe cache left into dir, and then the directory itself
+static void remove_cache_dir(const char *dir) {
+    char path[1024];
+    DIR *d = opendir(dir);
+    if(d == NULL) {
+        return;
+    }
+    struct dirent *entry;
+    while((entry = readdir(d)) != NULL) {
+        if(strstr(entry->d_name, ".kpc") != NULL || strstr(entry->d_name, ".tmp") != NULL) {
+            snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+            remove(path);
+        }
+    }
+    closedir(d);
+    remove(dir);
+}
+
+void test_Kit_CreateSourceFromUrlCached(void) {
+    char dir[1024];
+    temp_path(dir, sizeof(dir), "kit_test_probecache");
+    remove_cache_dir(dir);
+    CU_ASSERT_FATAL(mkdir(dir, 0700) == 0);
+
+    Kit_SourceOptions opts;
+    Kit_InitSourceOptions(&opts);
+    opts.cache_dir = dir;
+
+    // First open populates the cache, second one restores from it. Nothing here aborts the test,
+    // so that the cache directory is always removed.
+    for(int i = 0; i < 2; i++) {
+        Kit_Source *cached = Kit_CreateSourceFromUrlWithOptions("../../tests/data/CEP140_512kb.mp4", &opts);
+        CU_ASSERT_PTR_NOT_NULL(cached);
+        if(cached == NULL) {
+            break;
+        }
+        CU_ASSERT(cached->from_probe_cache == (i == 1));
+        CU_ASSERT(Kit_GetSourceStreamCount(cached) == 2);
+        CU_ASSERT(Kit_GetBestSourceStream(cached, KIT_STREAMTYPE_VIDEO) == 0);
+        CU_ASSERT(Kit_GetBestSourceStream(cached, KIT_STREAMTYPE_AUDIO) == 1);
+        Kit_CloseSource(cached);
+    }
+    remove_cache_dir(dir);
+
+    // A source opened without the cache must not claim to come from it
+    Kit_Source *uncached = Kit_CreateSourceFromUrl("../../tests/data/CEP140_512kb.mp4");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(uncached);
+    CU_ASSERT(!uncached->from_probe_cache);
+    Kit_CloseSource(uncached);
+}
+
+static Kit_AsyncSourceState wait_async_source(Kit_AsyncSource *handle) {
+    Kit_AsyncSourceState state;
+    while((state = Kit_GetAsyncSourceState(handle)) == KIT_ASYNC_PENDING) {
+        SDL_Delay(1);
+    }
+    return state;
+}
+
+void test_Kit_CreateSourceAsync(void) {
+    // Failures are reported through the handle only, never through the global error
+    Kit_ClearError();
+    Kit_AsyncSource *handle = Kit_CreateSourceAsync("nonexistent", NULL, NULL, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(handle);
+    CU_ASSERT(wait_async_source(handle) == KIT_ASYNC_FAILED);
+    CU_ASSERT_PTR_NOT_NULL(Kit_GetAsyncSourceError(handle));
+    CU_ASSERT(strcmp(Kit_GetAsyncSourceError(handle), "Unable to open source Url") == 0);
+    CU_ASSERT_PTR_NULL(Kit_TakeAsyncSource(handle));
+    CU_ASSERT_PTR_NULL(Kit_GetError());
+    Kit_CloseAsyncSource(handle);
+
+    // IO options are honoured the same way as with blocking opens
+    Kit_SourceOptions opts;
+    Kit_InitSourceOptions(&opts);
+    opts.readahead_mb = 1;
+    handle = Kit_CreateSourceAsync("../../tests/data/CEP140_512kb.mp4", &opts, NULL, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(handle);
+    CU_ASSERT(wait_async_source(handle) == KIT_ASYNC_READY);
+    Kit_Source *readahead = Kit_TakeAsyncSource(handle);
+    Kit_CloseAsyncSource(handle);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(readahead);
+    CU_ASSERT_PTR_NOT_NULL(readahead->avio_ctx);
+    Kit_CloseSource(readahead);
+
+    handle = Kit_CreateSourceAsync("../../tests/data/CEP140_512kb.mp4", NULL, NULL, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(handle);
+    CU_ASSERT(wait_async_source(handle) == KIT_ASYNC_READY);
+    Kit_Source *async = Kit_TakeAsyncSource(handle);
+    Kit_CloseAsyncSource(handle);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(async);
+    CU_ASSERT(Kit_GetSourceStreamCount(async) == 2);
+    Kit_CloseSource(async);
+}
+
+void test_Kit_ProbeFiles(void) {
+    const char *paths[] = {"../../tests/data/CEP140_512kb.mp4", "nonexistent", "../../tests/data/CEP140_512kb.mp4"};
+    Kit_ProbeResult results[3];
+    CU_ASSERT(Kit_ProbeFiles(paths, 3, results, 2) == 0);
+    CU_ASSERT(results[0].error == 0);
+    CU_ASSERT(results[1].error == 1);
+    CU_ASSERT(results[2].error == 0);
+    CU_ASSERT(results[0].error_message[0] == 0);
+    CU_ASSERT(strstr(results[1].error_message, "nonexistent") != NULL);
+    CU_ASSERT(results[0].stream_count == 2);
+    CU_ASSERT(results[0].duration > 0);
+    CU_ASSERT(results[0].streams[0].type == KIT_STREAMTYPE_VIDEO);
+    CU_ASSERT(results[0].streams[1].type == KIT_STREAMTYPE_AUDIO);
+    CU_ASSERT(results[0].streams[0].width > 0);
+    CU_ASSERT(results[0].streams[1].samplerate > 0);
+}
+
+void test_Kit_CreateSourceFromMemory(void) {
+    FILE *fp = fopen("../../tests/data/CEP140_512kb.mp4", "rb");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fp);
+    fseek(fp, 0, SEEK_END);
+    cached_file cf;
+    cf.filesize = ftell(fp);
+    cf.file_pointer = malloc(cf.filesize);
+    fseek(fp, 0, SEEK_SET);
+    CU_ASSERT(fread(cf.file_pointer, 1, cf.filesize, fp) == cf.filesize);
+    fclose(fp);
+
+    Kit_Source *mem = Kit_CreateSourceFromMemory(&cf);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(mem);
+    CU_ASSERT(Kit_GetSourceStreamCount(mem) == 2);
+    CU_ASSERT(Kit_GetBestSourceStream(mem, KIT_STREAMTYPE_VIDEO) == 0);
+    CU_ASSERT(((AVIOContext*)mem->avio_ctx)->seekable != 0);
+    check_source_io(mem);
+    Kit_CloseSource(mem);
+
+    // Blob must still belong to us after the source is gone
+    free(cf.file_pointer);
+}
+
+void test_Kit_CreateSourceFromMappedFile(void) {
+    CU_ASSERT_PTR_NULL(Kit_CreateSourceFromMappedFile("nonexistent"));
+    Kit_Source *mapped = Kit_CreateSourceFromMappedFile("../../tests/data/CEP140_512kb.mp4");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(mapped);
+    CU_ASSERT(Kit_GetSourceStreamCount(mapped) == 2);
+    CU_ASSERT(Kit_GetBestSourceStream(mapped, KIT_STREAMTYPE_AUDIO) == 1);
+
+    // Far jumps hint random access behind the new position, and readahead in front of it
+    check_source_io(mapped);
+
+    // A long contiguous read from the start walks through the readahead windows again
+    size_t size;
+    unsigned char *data = load_test_file(&size);
+    unsigned char *copy = malloc(size);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(data);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(copy);
+    CU_ASSERT(avio_seek(mapped->avio_ctx, 0, SEEK_SET) == 0);
+    CU_ASSERT(avio_read(mapped->avio_ctx, copy, size) == (int)size);
+    CU_ASSERT(memcmp(copy, data, size) == 0);
+    free(copy);
+    free(data);
+    Kit_CloseSource(mapped);
+}
+
+static int test_read_cb(void *userdata, unsigned char *buf, int size) {
+    return fread(buf, 1, size, (FILE*)userdata);
+}
+
+static int64_t test_seek_cb(void *userdata, int64_t offset, int whence) {
+    if(fseek((FILE*)userdata, offset, whence) != 0) {
+        return -1;
+    }
+    return ftell((FILE*)userdata);
+}
+
+static int64_t test_size_cb(void *userdata) {
+    FILE *fp = userdata;
+    long pos = ftell(fp);
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, pos, SEEK_SET);
+    return size;
+}
+
+void test_Kit_CreateSourceFromCallbacks(void) {
+    FILE *fp = fopen("../../tests/data/CEP140_512kb.mp4", "rb");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fp);
+    Kit_Source *cbsrc = Kit_CreateSourceFromCallbacks(test_read_cb, test_seek_cb, NULL, fp, 4096);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cbsrc);
+    CU_ASSERT(Kit_GetSourceStreamCount(cbsrc) == 2);
+    CU_ASSERT(Kit_GetBestSourceStream(cbsrc, KIT_STREAMTYPE_VIDEO) == 0);
+
+    // Without a size callback the size is unknown, but seeking still works
+    CU_ASSERT(avio_size(cbsrc->avio_ctx) < 0);
+    CU_ASSERT(avio_seek(cbsrc->avio_ctx, 1000, SEEK_SET) == 1000);
+    Kit_CloseSource(cbsrc);
+
+    rewind(fp);
+    cbsrc = Kit_CreateSourceFromCallbacks(test_read_cb, test_seek_cb, test_size_cb, fp, 4096);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cbsrc);
+    check_source_io(cbsrc);
+    Kit_CloseSource(cbsrc);
+
+    // Read-only callbacks give a non-seekable stream
+    rewind(fp);
+    cbsrc = Kit_CreateSourceFromCallbacks(test_read_cb, NULL, NULL, fp, 4096);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cbsrc);
+    CU_ASSERT(((AVIOContext*)cbsrc->avio_ctx)->seekable == 0);
+    Kit_CloseSource(cbsrc);
+    fclose(fp);
+}
+
+void test_Kit_CreateSourceFromUrlReadAhead(void) {
+    Kit_SourceOptions opts;
+    Kit_InitSourceOptions(&opts);
+    opts.readahead_mb = 1;
+    CU_ASSERT_PTR_NULL(Kit_CreateSourceFromUrlWithOptions("nonexistent", &opts));
+    Kit_Source *ra = Kit_CreateSourceFromUrlWithOptions("../../tests/data/CEP140_512kb.mp4", &opts);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ra);
+    CU_ASSERT(Kit_GetSourceStreamCount(ra) == 2);
+    CU_ASSERT(Kit_GetBestSourceStream(ra, KIT_STREAMTYPE_AUDIO) == 1);
+
+    // Seeks both inside and outside the 1MB window must drop stale readahead data
+    check_source_io(ra);
+    Kit_CloseSource(ra);
+}
+
+void test_Kit_CreateSourceFromUrlQueued(void) {
+    Kit_SourceOptions opts;
+    Kit_InitSourceOptions(&opts);
+    opts.queued_io = true;
+    CU_ASSERT_PTR_NULL(Kit_CreateSourceFromUrlWithOptions("nonexistent", &opts));
+    Kit_Source *queued = Kit_CreateSourceFromUrlWithOptions(TEST_FILE, &opts);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(queued);
+    CU_ASSERT(Kit_GetSourceStreamCount(queued) == 2);
+    check_source_io(queued);
+    Kit_CloseSource(queued);
+}
+
+void test_Kit_CreateSourceFromGrowingBuffer(void) {
+    FILE *fp = fopen("../../tests/data/CEP140_512kb.mp4", "rb");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fp);
+    Kit_GrowingBuffer *buffer = Kit_CreateGrowingBuffer(-1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(buffer);
+
+    // Push the file in small chunks, as a download would
+    char chunk[16384];
+    size_t len;
+    while((len = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+        CU_ASSERT(Kit_AppendGrowingBuffer(buffer, chunk, len) == 0);
+    }
+    fclose(fp);
+    Kit_FinishGrowingBuffer(buffer);
+    CU_ASSERT(Kit_AppendGrowingBuffer(buffer, chunk, 1) == 1);
+
+    Kit_Source *growing = Kit_CreateSourceFromGrowingBuffer(buffer, NULL);
+    Kit_FreeGrowingBuffer(buffer);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(growing);
+    CU_ASSERT(Kit_GetSourceStreamCount(growing) == 2);
+    Kit_CloseSource(growing);
+}
+
+typedef struct {
+    Kit_GrowingBuffer *buffer;
+    const unsigned char *data;
+    size_t len;
+    bool finish;
+    bool abort;
+} GrowingFeed;
+
+static int feed_growing_buffer(void *ptr) {
+    GrowingFeed *feed = ptr;
+    for(size_t pos = 0; pos < feed->len; pos += 16384) {
+        size_t chunk = feed->len - pos < 16384 ? feed->len - pos : 16384;
+        Kit_AppendGrowingBuffer(feed->buffer, feed->data + pos, chunk);
+        SDL_Delay(1);
+    }
+    if(feed->finish) {
+        Kit_FinishGrowingBuffer(feed->buffer);
+    }
+    if(feed->abort) {
+        SDL_Delay(50);
+        Kit_AbortGrowingBuffer(feed->buffer);
+    }
+    return 0;
+}
+
+void test_Kit_GrowingBufferBlockingRead(void) {
+    size_t size;
+    unsigned char *data = load_test_file(&size);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(data);
+
+    // Reads ahead of the download have to wait for the data instead of seeing a short stream
+    Kit_GrowingBuffer *buffer = Kit_CreateGrowingBuffer(size);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(buffer);
+    GrowingFeed feed = {buffer, data, size, true, false};
+    SDL_Thread *feeder = SDL_CreateThread(feed_growing_buffer, "Feeder", &feed);
+    Kit_Source *growing = Kit_CreateSourceFromGrowingBuffer(buffer, NULL);
+    CU_ASSERT_PTR_NOT_NULL(growing);
+    if(growing != NULL) {
+        check_source_io(growing);
+        Kit_CloseSource(growing);
+    }
+    SDL_WaitThread(feeder, NULL);
+    Kit_FreeGrowingBuffer(buffer);
+    free(data);
+}
+
+void test_Kit_GrowingBufferStall(void) {
+    size_t size;
+    unsigned char *data = load_test_file(&size);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(data);
+
+    // Open while the download is still running, then let it stall without finishing
+    Kit_GrowingBuffer *buffer = Kit_CreateGrowingBuffer(size);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(buffer);
+    GrowingFeed feed = {buffer, data, 1048576, false, false};
+    SDL_Thread *feeder = SDL_CreateThread(feed_growing_buffer, "Feeder", &feed);
+    Kit_Source *growing = Kit_CreateSourceFromGrowingBuffer(buffer, NULL);
+    SDL_WaitThread(feeder, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(growing);
+
+    // Without decoders nothing fills up, so the decoder thread reads until it blocks on the
+    // missing data. Closing the player must still return promptly.
+    Kit_SetSourceStream(growing, KIT_STREAMTYPE_VIDEO, -1);
+    Kit_SetSourceStream(growing, KIT_STREAMTYPE_AUDIO, -1);
+    Kit_SetSourceStream(growing, KIT_STREAMTYPE_SUBTITLE, -1);
+    Kit_Player *player = Kit_CreatePlayer(growing);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(player);
+    Kit_PlayerPlay(player);
+    SDL_Delay(200);
+    Uint32 start = SDL_GetTicks();
+    Kit_ClosePlayer(player);
+    CU_ASSERT(SDL_GetTicks() - start < 1000);
+
+    // Dropping our reference while the source still holds one leaves the download unfinished
+    Kit_FreeGrowingBuffer(buffer);
+    CU_ASSERT(!buffer->finished);
+    Kit_CloseSource(growing);
+
+    // Aborting wakes up an open that is waiting for the headers
+    buffer = Kit_CreateGrowingBuffer(-1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(buffer);
+    GrowingFeed empty = {buffer, data, 0, false, true};
+    feeder = SDL_CreateThread(feed_growing_buffer, "Feeder", &empty);
+    CU_ASSERT_PTR_NULL(Kit_CreateSourceFromGrowingBuffer(buffer, NULL));
+    SDL_WaitThread(feeder, NULL);
+    CU_ASSERT(Kit_AppendGrowingBuffer(buffer, data, 1) == 1);
+    Kit_FreeGrowingBuffer(buffer);
+    free(data);
+}
+
+void test_Kit_KeyframeIndex(void) {
+    CU_ASSERT_PTR_NULL(Kit_BuildKeyframeIndex("nonexistent", -1));
+    Kit_KeyframeIndex *index = Kit_BuildKeyframeIndex("../../tests/data/CEP140_512kb.mp4", -1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(index);
+    CU_ASSERT(index->stream_idx == 0);
+    CU_ASSERT(index->count > 0);
+    CU_ASSERT(Kit_FindKeyframe(index, 0) == 0);
+    CU_ASSERT(Kit_FindKeyframe(index, 1000000) == index->count - 1);
+
+    // Sidecar must round trip exactly
+    char path[1024];
+    temp_path(path, sizeof(path), "kit_test_keyframes.kki");
+    CU_ASSERT(Kit_SaveKeyframeIndex(index, path) == 0);
+    Kit_KeyframeIndex *loaded = Kit_LoadKeyframeIndex(path);
+    remove(path);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(loaded);
+    CU_ASSERT(loaded->count == index->count);
+    CU_ASSERT(loaded->tb_den == index->tb_den);
+    CU_ASSERT(memcmp(loaded->pts, index->pts, index->count * sizeof(int64_t)) == 0);
+    CU_ASSERT(memcmp(loaded->pos, index->pos, index->count * sizeof(int64_t)) == 0);
+
+    // A corrupt entry count larger than the file could hold is refused before allocating for it
+    static const unsigned char corrupt[] = {
+        'K', 'K', 'I', '1', 0, 1, 0x80, 0x01, 0xFF, 0xFF, 0xFF, 0xFF, 0x07, 0x02, 0x02
+    };
+    FILE *fp = fopen(path, "wb");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fp);
+    CU_ASSERT(fwrite(corrupt, 1, sizeof(corrupt), fp) == sizeof(corrupt));
+    fclose(fp);
+    CU_ASSERT_PTR_NULL(Kit_LoadKeyframeIndex(path));
+    remove(path);
+
+    Kit_Source *indexed = Kit_CreateSourceFromUrl(TEST_FILE);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(indexed);
+    CU_ASSERT(Kit_SetSourceKeyframeIndex(indexed, loaded) == 0);
+    CU_ASSERT(indexed->keyframe_index == loaded);
+    CU_ASSERT(Kit_SetSourceKeyframeIndex(indexed, NULL) == 0);
+    CU_ASSERT_PTR_NULL(indexed->keyframe_index);
+    Kit_CloseSource(indexed);
+    Kit_FreeKeyframeIndex(loaded);
+    Kit_FreeKeyframeIndex(index);
+}
+
+void test_Kit_ExtractThumbnail(void) {
+    unsigned int hits, misses;
+    Kit_Source *thumbsrc = Kit_CreateSourceFromUrl(TEST_FILE);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(thumbsrc);
+    SDL_Surface *thumb = Kit_ExtractThumbnail(thumbsrc, 10.0, 160, 0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(thumb);
+    CU_ASSERT(thumb->w == 160);
+    CU_ASSERT(thumb->h > 0);
+    Kit_GetThumbnailCacheStats(thumbsrc, &hits, &misses);
+    CU_ASSERT(hits == 0 && misses == 1);
+
+    // Second lookup is served from the cache, and must give the same picture
+    SDL_Surface *again = Kit_ExtractThumbnail(thumbsrc, 10.0, 160, 0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(again);
+    CU_ASSERT(again->h == thumb->h);
+    CU_ASSERT(memcmp(again->pixels, thumb->pixels, thumb->pitch * thumb->h) == 0);
+    Kit_GetThumbnailCacheStats(thumbsrc, &hits, &misses);
+    CU_ASSERT(hits == 1 && misses == 1);
+    SDL_FreeSurface(again);
+
+    // Any time up to the next keyframe resolves to the same entry through the keyframe index
+    Kit_KeyframeIndex *index = Kit_BuildKeyframeIndex(TEST_FILE, -1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(index);
+    CU_ASSERT(Kit_SetSourceKeyframeIndex(thumbsrc, index) == 0);
+    int k = Kit_FindKeyframe(index, 10.0);
+    CU_ASSERT_FATAL(k >= 0 && k + 1 < index->count);
+    double next = (double)index->pts[k + 1] * index->tb_num / index->tb_den;
+    again = Kit_ExtractThumbnail(thumbsrc, (10.0 + next) / 2, 160, 0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(again);
+    CU_ASSERT(memcmp(again->pixels, thumb->pixels, thumb->pitch * thumb->h) == 0);
+    Kit_GetThumbnailCacheStats(thumbsrc, &hits, &misses);
+    CU_ASSERT(hits == 2 && misses == 1);
+    SDL_FreeSurface(again);
+
+    // The next keyframe is a different picture
+    again = Kit_ExtractThumbnail(thumbsrc, next, 160, 0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(again);
+    Kit_GetThumbnailCacheStats(thumbsrc, &hits, &misses);
+    CU_ASSERT(hits == 2 && misses == 2);
+    SDL_FreeSurface(again);
+
+    SDL_FreeSurface(thumb);
+    Kit_CloseSource(thumbsrc);
+    Kit_FreeKeyframeIndex(index);
+}
+
+#define PARALLEL_MAX_FRAMES 8192
+
+typedef struct {
+    int frames;
+    double last_pts;
+    bool ordered;
+    int limit;
+    double pts[PARALLEL_MAX_FRAMES];
+} ParallelDecodeState;
+
+static int parallel_decode_cb(SDL_Surface *frame, double pts, void *userdata) {
+    ParallelDecodeState *state = userdata;
+    if(frame->w != 64 || pts < state->last_pts) {
+        state->ordered = false;
+    }
+    state->last_pts = pts;
+    if(state->frames < PARALLEL_MAX_FRAMES) {
+        state->pts[state->frames] = pts;
+    }
+    return ++state->frames >= state->limit;
+}
+
+// Plain single threaded decode of the whole video stream, as a reference for the segmented one
+static int serial_decode(double *pts, int max_frames) {
+    AVFormatContext *format_ctx = NULL;
+    AVPacket packet;
+    int frames = 0;
+    int frame_finished;
+
+    if(avformat_open_input(&format_ctx, TEST_FILE, NULL, NULL) < 0) {
+        return -1;
+    }
+    avformat_find_stream_info(format_ctx, NULL);
+    int stream_idx = av_find_best_stream(format_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    AVStream *stream = format_ctx->streams[stream_idx];
+    AVCodec *codec = avcodec_find_decoder(stream->codec->codec_id);
+    AVCodecContext *codec_ctx = avcodec_alloc_context3(codec);
+    avcodec_copy_context(codec_ctx, stream->codec);
+    avcodec_open2(codec_ctx, codec, NULL);
+    AVFrame *frame = av_frame_alloc();
+    double time_base = av_q2d(stream->time_base);
+
+    av_init_packet(&packet);
+    bool reading = true;
+    do {
+        reading = av_read_frame(format_ctx, &packet) >= 0;
+        if(!reading) {
+            packet.data = NULL;
+            packet.size = 0;
+        } else if(packet.stream_index != stream_idx) {
+            av_packet_unref(&packet);
+            continue;
+        }
+        AVPacket data = packet;
+        do {
+            int len = avcodec_decode_video2(codec_ctx, frame, &frame_finished, &data);
+            if(len < 0) {
+                break;
+            }
+            int64_t ts = av_frame_get_best_effort_timestamp(frame);
+            if(frame_finished && ts != AV_NOPTS_VALUE && frames < max_frames) {
+                pts[frames++] = ts * time_base;
+            }
+            if(data.size > 0) {
+                data.size -= len;
+                data.data += len;
+            }
+        } while(data.size > 0 || (!reading && frame_finished));
+        av_packet_unref(&packet);
+    } while(reading);
+
+    av_frame_free(&frame);
+    avcodec_close(codec_ctx);
+    avcodec_free_context(&codec_ctx);
+    avformat_close_input(&format_ctx);
+    return frames;
+}
+
+void test_Kit_DecodeFileParallel(void) {
+    ParallelDecodeState *state = calloc(1, sizeof(ParallelDecodeState));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(state);
+    state->last_pts = -1.0;
+    state->ordered = true;
+    state->limit = 500;
+    CU_ASSERT(Kit_DecodeFileParallel("nonexistent", NULL, 64, 0, 4, parallel_decode_cb, state) == 1);
+    CU_ASSERT(Kit_DecodeFileParallel(TEST_FILE, NULL, 64, 0, 4, parallel_decode_cb, state) == 0);
+    CU_ASSERT(state->frames == 500);
+    CU_ASSERT(state->ordered);
+
+    // The whole file must come out exactly as a serial decode gives it: same frames, same order
+    double *serial = malloc(PARALLEL_MAX_FRAMES * sizeof(double));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(serial);
+    int serial_frames = serial_decode(serial, PARALLEL_MAX_FRAMES);
+    CU_ASSERT_FATAL(serial_frames > 500 && serial_frames < PARALLEL_MAX_FRAMES);
+    memset(state, 0, sizeof(ParallelDecodeState));
+    state->last_pts = -1.0;
+    state->ordered = true;
+    state->limit = PARALLEL_MAX_FRAMES;
+    CU_ASSERT(Kit_DecodeFileParallel(TEST_FILE, NULL, 64, 0, 4, parallel_decode_cb, state) == 0);
+    CU_ASSERT(state->ordered);
+    CU_ASSERT(state->frames == serial_frames);
+    int mismatches = 0;
+    for(int i = 0; i < serial_frames && i < state->frames; i++) {
+        if(state->pts[i] != serial[i]) {
+            mismatches++;
+        }
+    }
+    CU_ASSERT(mismatches == 0);
+    free(serial);
+    free(state);
+}
+
 void source_test_suite(CU_pSuite suite) {
     if(CU_add_test(suite, "Kit_CreateSourceFromUrl", test_Kit_CreateSourceFromUrl) == NULL) { return; }
     if(CU_add_test(suite, "Kit_GetBestSourceStream", test_Kit_GetBestSourceStream) == NULL) { return; }
     if(CU_add_test(suite, "Kit_GetSourceStreamCount", test_Kit_GetSourceStreamCount) == NULL) { return; }
     if(CU_add_test(suite, "Kit_SetSourceStream", test_Kit_SetSourceStream) == NULL) { return; }
     if(CU_add_test(suite, "Kit_GetSourceStream", test_Kit_GetSourceStream) == NULL) { return; }
+    if(CU_add_test(suite, "Kit_CreateSourceFromUrlWithOptions", test_Kit_CreateSourceFromUrlWithOptions) == NULL) { return; }
+    if(CU_add_test(suite, "Kit_CreateSourceFromUrlCached", test_Kit_CreateSourceFromUrlCached) == NULL) { return; }
+    if(CU_add_test(suite, "Kit_CreateSourceAsync", test_Kit_CreateSourceAsync) == NULL) { return; }
+    if(CU_add_test(suite, "Kit_ProbeFiles", test_Kit_ProbeFiles) == NULL) { return; }
+    if(CU_add_test(suite, "Kit_CreateSourceFromMemory", test_Kit_CreateSourceFromMemory) == NULL) { return; }
+    if(CU_add_test(suite, "Kit_CreateSourceFromMappedFile", test_Kit_CreateSourceFromMappedFile) == NULL) { return; }
+    if(CU_add_test(suite, "Kit_CreateSourceFromCallbacks", test_Kit_CreateSourceFromCallbacks) == NULL) { return; }
+    if(CU_add_test(suite, "Kit_CreateSourceFromUrlReadAhead", test_Kit_CreateSourceFromUrlReadAhead) == NULL) { return; }
+    if(CU_add_test(suite, "Kit_CreateSourceFromUrlQueued", test_Kit_CreateSourceFromUrlQueued) == NULL) { return; }
+    if(CU_add_test(suite, "Kit_CreateSourceFromGrowingBuffer", test_Kit_CreateSourceFromGrowingBuffer) == NULL) { return; }
+    if(CU_add_test(suite, "Kit_GrowingBufferBlockingRead", test_Kit_GrowingBufferBlockingRead) == NULL) { return; }
+    if(CU_add_test(suite, "Kit_GrowingBufferStall", test_Kit_GrowingBufferStall) == NULL) { return; }
+    if(CU_add_test(suite, "Kit_KeyframeIndex", test_Kit_KeyframeIndex) == NULL) { return; }
+    if(CU_add_test(suite, "Kit_ExtractThumbnail", test_Kit_ExtractThumbnail) == NULL) { return; }
+    if(CU_add_test(suite, "Kit_DecodeFileParallel", test_Kit_DecodeFileParallel) == NULL) { return; }
     if(CU_add_test(suite, "Kit_CloseSource", test_Kit_CloseSource) == NULL) { return; }
 }